@@ -0,0 +1,352 @@
+/*
+ * ============================================================================
+ * Forward Mode Autodiff Batched Across Samples
+ * ============================================================================
+ * This header-only C implementation evaluates the same computation at
+ * `BATCH_LEN` data points at once, with forward mode automatic differentiation
+ * using operator overloading on a custom `batch_t` type.
+ *
+ * Each `batch_t` variable holds:
+ *  - `value`: the values of the variable at each of the `BATCH_LEN` samples,
+ *  - `grad[GRADLEN]`: for each input, the derivatives of the variable with
+ *    respect to that input at each sample.
+ * Every operation loops over the samples in its innermost loop, the values
+ * and the derivatives of `BATCH_LEN` samples are computed by the same vector
+ * instructions. This vectorizes computations that `forward.h` can not, the
+ * ones with few inputs evaluated at many points, where the `GRADLEN` lanes of
+ * `forward.h` are too few to fill a vector register.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute Σ_j (a x_j + b - y_j)² and its gradient for 8 points (x_j, y_j):
+ *   batch_t a = batch_variable(1.0, 0);  // same value at every sample
+ *   batch_t b = batch_variable(0.5, 1);
+ *   batch_real_t x = batch_real_load(xs), y = batch_real_load(ys);
+ *   batch_t delta = a * x + b - y;
+ *   AD_REAL loss, grad[GRADLEN];
+ *   batch_reduce(delta * delta, &loss, grad);
+ *   // loss holds the sum over the samples, grad[0] is ∂loss/∂a
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - The macro `GRADLEN` must be defined before including this header. Define
+ *    `BATCH_LEN` (default 8, the floats of an AVX register) to change the
+ *    number of samples of a batch.
+ *  - `batch_real_t` holds plain per-sample data, such as the coordinates of
+ *    the points, operations with it cost less than with a `batch_t` constant.
+ *  - Define `AD_REAL` (default `float`) to change the type of the values and
+ *    of the derivatives, e.g. `double`.
+ *  - The operations are named as in `forward.h`, so that a computation can be
+ *    written once for both headers.
+ */
+
+#ifndef H_BATCH
+#define H_BATCH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#ifndef GRADLEN
+#error "The GRADLEN macro must set before including batch.h"
+#define GRADLEN 1
+#endif
+
+/* number of samples evaluated together */
+#ifndef BATCH_LEN
+#define BATCH_LEN 8
+#endif
+
+#ifndef AD_REAL
+#define AD_REAL float
+#endif
+
+/* a value per sample */
+typedef struct {
+  AD_REAL lanes[BATCH_LEN];
+} batch_real_t;
+
+typedef struct {
+  batch_real_t value;
+  batch_real_t grad[GRADLEN];
+} batch_t;
+
+/* per-sample data */
+static batch_real_t batch_real_create(AD_REAL value) {
+  batch_real_t a;
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    a.lanes[l] = value;
+  return a;
+}
+
+/* the `BATCH_LEN` values at `values` */
+static batch_real_t batch_real_load(const AD_REAL *values) {
+  batch_real_t a;
+  memcpy(a.lanes, values, sizeof(a.lanes));
+  return a;
+}
+
+/* a constant with the same value at every sample */
+static batch_t batch_create(AD_REAL value) {
+  batch_t a;
+  memset(&a, 0, sizeof(a));
+  a.value = batch_real_create(value);
+  return a;
+}
+
+/* a constant with a value per sample */
+static batch_t batch_constant(const batch_real_t &value) {
+  batch_t a;
+  memset(&a, 0, sizeof(a));
+  a.value = value;
+  return a;
+}
+
+/* the input `i` of the gradient, with the same value at every sample */
+static batch_t batch_variable(AD_REAL value, size_t i) {
+  assert(i < GRADLEN);
+  batch_t a = batch_create(value);
+  a.grad[i] = batch_real_create(1);
+  return a;
+}
+
+static AD_REAL batch_value(const batch_t &a, size_t lane) {
+  assert(lane < BATCH_LEN);
+  return a.value.lanes[lane];
+}
+
+/* derivative of `a` with respect to the input `i` at the sample `lane` */
+static AD_REAL batch_derivative(const batch_t &a, size_t i, size_t lane) {
+  assert(i < GRADLEN && lane < BATCH_LEN);
+  return a.grad[i].lanes[lane];
+}
+
+/* store in `value` and `grad` the sums of the value and the gradient of `a` over the samples */
+static void batch_reduce(const batch_t &a, AD_REAL *value, AD_REAL grad[GRADLEN]) {
+  *value = 0;
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    *value += a.value.lanes[l];
+  for (size_t i = 0; i < GRADLEN; ++i) {
+    grad[i] = 0;
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      grad[i] += a.grad[i].lanes[l];
+  }
+}
+
+/*
+ * the variable of values `value` whose partial derivative with respect to `a`
+ * is `partial`, at each sample
+ */
+static batch_t batch_unary(const batch_t &a, const batch_real_t &value,
+                           const batch_real_t &partial) {
+  batch_t c;
+  c.value = value;
+  for (size_t i = 0; i < GRADLEN; ++i)
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      c.grad[i].lanes[l] = partial.lanes[l] * a.grad[i].lanes[l];
+  return c;
+}
+
+/* same as `batch_unary` with the partial derivatives with respect to `a` and `b` */
+static batch_t batch_binary(const batch_t &a, const batch_t &b, const batch_real_t &value,
+                            const batch_real_t &a_partial, const batch_real_t &b_partial) {
+  batch_t c;
+  c.value = value;
+  for (size_t i = 0; i < GRADLEN; ++i)
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      c.grad[i].lanes[l] = a_partial.lanes[l] * a.grad[i].lanes[l] +
+                           b_partial.lanes[l] * b.grad[i].lanes[l];
+  return c;
+}
+
+/* variable operations */
+static batch_t operator-(batch_t a) {
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    a.value.lanes[l] = -a.value.lanes[l];
+  for (size_t i = 0; i < GRADLEN; ++i)
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      a.grad[i].lanes[l] = -a.grad[i].lanes[l];
+  return a;
+}
+
+/* variable variable operations */
+static batch_t operator+(batch_t a, const batch_t &b) {
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    a.value.lanes[l] += b.value.lanes[l];
+  for (size_t i = 0; i < GRADLEN; ++i)
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      a.grad[i].lanes[l] += b.grad[i].lanes[l];
+  return a;
+}
+
+static batch_t operator-(batch_t a, const batch_t &b) {
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    a.value.lanes[l] -= b.value.lanes[l];
+  for (size_t i = 0; i < GRADLEN; ++i)
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      a.grad[i].lanes[l] -= b.grad[i].lanes[l];
+  return a;
+}
+
+static batch_t operator*(const batch_t &a, const batch_t &b) {
+  batch_real_t value;
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    value.lanes[l] = a.value.lanes[l] * b.value.lanes[l];
+  return batch_binary(a, b, value, b.value, a.value);
+}
+
+static batch_t operator/(const batch_t &a, const batch_t &b) {
+  batch_real_t value, a_partial, b_partial;
+  for (size_t l = 0; l < BATCH_LEN; ++l) {
+    value.lanes[l] = a.value.lanes[l] / b.value.lanes[l];
+    a_partial.lanes[l] = 1 / b.value.lanes[l];
+    b_partial.lanes[l] = -value.lanes[l] / b.value.lanes[l];
+  }
+  return batch_binary(a, b, value, a_partial, b_partial);
+}
+
+static void operator+=(batch_t &a, const batch_t &b) {
+  a = a + b;
+}
+
+static void operator-=(batch_t &a, const batch_t &b) {
+  a = a - b;
+}
+
+static void operator*=(batch_t &a, const batch_t &b) {
+  a = a * b;
+}
+
+static void operator/=(batch_t &a, const batch_t &b) {
+  a = a / b;
+}
+
+/* variable per-sample data operations */
+static batch_t operator+(batch_t a, const batch_real_t &b) {
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    a.value.lanes[l] += b.lanes[l];
+  return a;
+}
+
+static batch_t operator-(batch_t a, const batch_real_t &b) {
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    a.value.lanes[l] -= b.lanes[l];
+  return a;
+}
+
+static batch_t operator*(batch_t a, const batch_real_t &b) {
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    a.value.lanes[l] *= b.lanes[l];
+  for (size_t i = 0; i < GRADLEN; ++i)
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      a.grad[i].lanes[l] *= b.lanes[l];
+  return a;
+}
+
+static batch_t operator/(const batch_t &a, const batch_real_t &b) {
+  batch_real_t inverse;
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    inverse.lanes[l] = 1 / b.lanes[l];
+  return a * inverse;
+}
+
+static batch_t operator/(const batch_real_t &a, const batch_t &b) {
+  batch_real_t value, partial;
+  for (size_t l = 0; l < BATCH_LEN; ++l) {
+    value.lanes[l] = a.lanes[l] / b.value.lanes[l];
+    partial.lanes[l] = -value.lanes[l] / b.value.lanes[l];
+  }
+  return batch_unary(b, value, partial);
+}
+
+static batch_t operator+(const batch_real_t &a, const batch_t &b) {
+  return b + a;
+}
+
+static batch_t operator-(const batch_real_t &a, const batch_t &b) {
+  return -b + a;
+}
+
+static batch_t operator*(const batch_real_t &a, const batch_t &b) {
+  return b * a;
+}
+
+/* variable float operations */
+static batch_t operator+(const batch_t &a, AD_REAL b) {
+  return a + batch_real_create(b);
+}
+
+static batch_t operator-(const batch_t &a, AD_REAL b) {
+  return a - batch_real_create(b);
+}
+
+static batch_t operator*(const batch_t &a, AD_REAL b) {
+  return a * batch_real_create(b);
+}
+
+static batch_t operator/(AD_REAL a, const batch_t &b) {
+  return batch_real_create(a) / b;
+}
+
+static void operator+=(batch_t &a, AD_REAL b) {
+  a = a + b;
+}
+
+static void operator-=(batch_t &a, AD_REAL b) {
+  a = a - b;
+}
+
+static void operator*=(batch_t &a, AD_REAL b) {
+  a = a * b;
+}
+
+/* variable functions */
+static batch_t var_pow(const batch_t &a, AD_REAL b) {
+  batch_real_t value, partial;
+  for (size_t l = 0; l < BATCH_LEN; ++l) {
+    assert(a.value.lanes[l] > 0);
+    value.lanes[l] = pow(a.value.lanes[l], b);
+    partial.lanes[l] = b * value.lanes[l] / a.value.lanes[l];
+  }
+  return batch_unary(a, value, partial);
+}
+
+static batch_t var_exp(const batch_t &a) {
+  batch_real_t value;
+  for (size_t l = 0; l < BATCH_LEN; ++l)
+    value.lanes[l] = exp(a.value.lanes[l]);
+  return batch_unary(a, value, value);
+}
+
+static batch_t var_cos(const batch_t &a) {
+  batch_real_t value, partial;
+  for (size_t l = 0; l < BATCH_LEN; ++l) {
+    value.lanes[l] = cos(a.value.lanes[l]);
+    partial.lanes[l] = -sin(a.value.lanes[l]);
+  }
+  return batch_unary(a, value, partial);
+}
+
+static batch_t var_sin(const batch_t &a) {
+  batch_real_t value, partial;
+  for (size_t l = 0; l < BATCH_LEN; ++l) {
+    value.lanes[l] = sin(a.value.lanes[l]);
+    partial.lanes[l] = cos(a.value.lanes[l]);
+  }
+  return batch_unary(a, value, partial);
+}
+
+static batch_t var_sqrt(const batch_t &a) {
+  batch_real_t value, partial;
+  for (size_t l = 0; l < BATCH_LEN; ++l) {
+    /* assert(a.value.lanes[l] > 0); */
+    value.lanes[l] = sqrt(a.value.lanes[l]);
+    partial.lanes[l] = 1 / (2 * value.lanes[l]);
+  }
+  return batch_unary(a, value, partial);
+}
+
+#endif
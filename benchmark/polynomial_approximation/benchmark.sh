@@ -7,7 +7,13 @@ bench() {
   forward=$(./forward_build_"$1")
   forward_novec=$(./forward_build_novec_"$1")
   forward_gradlen=$(./forward_build_gradlen_"$1"_"$gradlen")
-  echo "$1","$reverse","$forward","$forward_novec","$forward_gradlen"
+  forward_sparse=$(./forward_build_sparse_"$1")
+  forward_simd=$(./forward_build_simd_"$1")
+  forward_simd_novec=$(./forward_build_simd_novec_"$1")
+  forward_expr=$(./forward_build_expr_"$1")
+  forward_gradlen_expr=$(./forward_build_gradlen_expr_"$1"_"$gradlen")
+  forward_batch=$(./forward_build_batch_"$1")
+  echo "$1","$reverse","$forward","$forward_novec","$forward_gradlen","$forward_sparse","$forward_simd","$forward_simd_novec","$forward_expr","$forward_gradlen_expr","$forward_batch"
 }
 
 deg=(1 $(seq 2 2 512))
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+
+# compare the gradient of the reimann sum recorded on a single tape with the
+# one of reverse_checkpoint.h for different numbers of checkpoints, each line
+# is checkpoints,tape runtime,checkpointing runtime,relative difference of the
+# gradients with the runtimes in milliseconds
+
+d=20
+
+make reverse_checkpoint DEG=$d > /dev/null
+
+bench() {
+  checkpoint=$(./reverse_build_checkpoint_"$d" "$1")
+  echo "$1","$checkpoint"
+}
+
+checkpoints=(1 2 4 8 16 32 64 1000)
+for c in ${checkpoints[@]}; do
+  bench $c
+done
+
+make clean
@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+
+deg=300
+
+# a single executable covers every gradient length
+make forward_dynamic > /dev/null
+
+bench() {
+  forward_dynamic=$(./forward_dynamic_build "$deg" "$1")
+  echo "$1","$forward_dynamic"
+}
+
+gradlen=($(seq 4 1 512))
+for gl in ${gradlen[@]}; do
+  bench $gl
+done
+
+make clean
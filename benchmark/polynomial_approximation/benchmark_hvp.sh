@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+
+# each measurement is the runtime of the gradient and of the Hessian-vector
+# product in milliseconds followed by the relative difference of the product
+# with finite differences of gradients
+bench() {
+  hvp_float=$(./reverse_build_hvp_float_"$1")
+  hvp_double=$(./reverse_build_hvp_double_"$1")
+  echo "$1","$hvp_float","$hvp_double"
+}
+
+deg=(4 8 16 32 64)
+for d in ${deg[@]}; do
+  make -j reverse_hvp DEG=$d > /dev/null &
+done
+wait
+
+for d in ${deg[@]}; do
+  bench $d
+done
+
+make clean
@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+
+# calibrate the cost model of reverse_jacobian.h on this machine with the
+# Jacobian of the residuals of the reimann sum, prints the compiler flags to
+# build with, e.g. `./benchmark_jacobian.sh ADJLEN=8` for a build with ADJLEN=8
+
+deg=20
+
+make reverse_jacobian DEG=$deg "$@" > /dev/null
+./reverse_build_jacobian_$deg
+echo
+
+make clean > /dev/null
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+
+d=4
+
+bench() {
+  reverse_levels=$(./reverse_levels_build_workers_"$d"_"$1")
+  echo "$1","$reverse_levels"
+}
+
+workers=$(seq 1 1 12)
+for w in ${workers[@]}; do
+  make -j reverse_levels_workers DEG=$d WORKERS=$w > /dev/null &
+done
+wait
+
+for w in ${workers[@]}; do
+  bench $w
+done
+
+make clean
@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+
+# each measurement is a runtime in milliseconds followed by the relative error
+# of the gradient
+bench() {
+  forward_float=$(./forward_build_precision_float_"$1")
+  forward_double=$(./forward_build_precision_double_"$1")
+  forward_bf16=$(./forward_build_precision_bf16_"$1")
+  forward_fp16=$(./forward_build_precision_fp16_"$1")
+  reverse_float=$(./reverse_build_precision_float_"$1")
+  reverse_double=$(./reverse_build_precision_double_"$1")
+  echo "$1","$forward_float","$forward_double","$forward_bf16","$forward_fp16","$reverse_float","$reverse_double"
+}
+
+# x^DEG overflows float for DEG > 127 on [0, 2]
+deg=(4 8 $(seq 16 16 112))
+for d in ${deg[@]}; do
+  make -j precision DEG=$d > /dev/null &
+done
+wait
+
+for d in ${deg[@]}; do
+  bench $d
+done
+
+make clean
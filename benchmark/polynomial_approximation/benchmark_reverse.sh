@@ -2,12 +2,17 @@
 
 bench() {
   reverse=$(./reverse_build_"$1")
-  echo "$d","$reverse"
+  reverse_soa=$(./reverse_build_soa_"$1")
+  reverse_mmap=$(./reverse_build_mmap_"$1")
+  reverse_replay=$(./reverse_build_replay_"$1")
+  reverse_preacc=$(./reverse_build_preacc_"$1")
+  reverse_fused=$(./reverse_build_fused_"$1")
+  echo "$d","$reverse","$reverse_soa","$reverse_mmap","$reverse_replay","$reverse_preacc","$reverse_fused"
 }
 
 deg=(4 8 $(seq 4 16 512))
 for d in ${deg[@]}; do
-  make -j reverse DEG=$d > /dev/null &
+  make -j reverse reverse_soa reverse_mmap reverse_replay reverse_preacc reverse_fused DEG=$d > /dev/null &
 done
 wait
 
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+
+d=500
+
+bench() {
+  reverse_parallel=$(./reverse_parallel_build_workers_"$d"_"$1")
+  echo "$1","$reverse_parallel"
+}
+
+workers=$(seq 1 1 12)
+for w in ${workers[@]}; do
+  make -j reverse_parallel_workers DEG=$d WORKERS=$w > /dev/null &
+done
+wait
+
+for w in ${workers[@]}; do
+  bench $w
+done
+
+make clean
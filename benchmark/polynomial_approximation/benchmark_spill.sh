@@ -0,0 +1,21 @@
+#!/usr/bin/env bash
+
+# compare the in-memory tape with the tape spilled to disk (TAPE_SPILL), both
+# in structure of arrays layout, each line is
+# entries,record memory,reverse memory,record spill,reverse spill
+# with the throughputs in entries per second
+
+make -j reverse_throughput reverse_throughput_spill > /dev/null
+
+bench() {
+  memory=$(./reverse_build_throughput "$1")
+  spill=$(./reverse_build_throughput_spill "$1")
+  echo "$memory","${spill#*,}"
+}
+
+entries=(1000000 10000000 100000000 1000000000)
+for e in ${entries[@]}; do
+  bench $e
+done
+
+make clean
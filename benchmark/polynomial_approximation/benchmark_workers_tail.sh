@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+
+# DEG+1 is not a multiple of GRADLEN so the chunks can't be split evenly
+d=65
+gradlen=64
+
+bench() {
+  stealing=$(./parallel_build_tail_"$d"_"$1")
+  static=$(./parallel_build_tail_static_"$d"_"$1")
+  echo "$1","$stealing","$static"
+}
+
+workers=$(seq 1 1 12)
+for w in ${workers[@]}; do
+  make -j parallel_tail DEG=$d GRADLEN=$gradlen WORKERS=$w > /dev/null &
+done
+wait
+
+for w in ${workers[@]}; do
+  bench $w
+done
+
+make clean
@@ -36,9 +36,10 @@ var_t poly_eval(var_t P[DEG+1], float x) {
 
 void poly_init(var_t P[DEG+1], size_t grad_start, size_t grad_end) {
   for (size_t i = 0; i < DEG+1; ++i) {
-    P[i] = {.grad = {0}, .value = (float) i+1};
+    var_zero(&P[i]);
+    P[i].value = i+1;
     if (i >= grad_start && i < grad_end) {
-      P[i].grad[i - grad_start] = 1;
+      var_seed(&P[i], i - grad_start);
     }
   }
 }
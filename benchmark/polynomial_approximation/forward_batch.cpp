@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+#ifndef GRADLEN
+#warning "GRADLEN set to default value 8"
+#define GRADLEN 8
+#endif
+#include "../../batch.h"
+
+/* the function to approximate */
+float f(float x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+batch_t poly_eval(batch_t P[DEG+1], const batch_real_t &x) {
+  batch_t val = P[0];
+  batch_real_t X = x;
+  for (size_t i = 1; i < DEG+1; i++) {
+    val += P[i] * X;
+    for (size_t l = 0; l < BATCH_LEN; ++l)
+      X.lanes[l] *= x.lanes[l];
+  }
+  return val;
+}
+
+void poly_init(batch_t P[DEG+1], size_t grad_start, size_t grad_end) {
+  for (size_t i = 0; i < DEG+1; ++i) {
+    if (i >= grad_start && i < grad_end) {
+      P[i] = batch_variable(i+1, i - grad_start);
+    } else {
+      P[i] = batch_create(i+1);
+    }
+  }
+}
+
+/* BATCH_LEN terms of the sum at once, the lanes past N have a zero weight */
+batch_t reimann_integral(batch_t P[DEG+1]) {
+  batch_t loss = batch_create(0);
+
+  float step_size = (END-START) / N;
+  for (size_t j = 0; j < N; j += BATCH_LEN) {
+    batch_real_t x, fx, weight;
+    for (size_t l = 0; l < BATCH_LEN; ++l) {
+      x.lanes[l] = START + (j+l)*step_size;
+      fx.lanes[l] = f(x.lanes[l]);
+      weight.lanes[l] = j+l < N ? step_size : 0;
+    }
+    batch_t delta = poly_eval(P, x) - fx;
+    loss = loss + (delta*delta) * weight;
+  }
+
+  return loss;
+}
+
+int main() {
+  size_t runs = 10;
+  float start_time, end_time;
+  AD_REAL value, grad[GRADLEN];
+
+  start_time = (float) clock() / CLOCKS_PER_SEC;
+  for (size_t i = 0; i < runs; ++i) {
+    for (size_t grad_start = 0; grad_start < DEG+1; grad_start += GRADLEN) {
+      batch_t P[DEG+1];
+      poly_init(P, grad_start, grad_start + GRADLEN);
+      batch_t loss = reimann_integral(P);
+      batch_reduce(loss, &value, grad);
+    }
+  }
+  end_time = (float) clock() / CLOCKS_PER_SEC;
+
+  /* print average runtime in milliseconds */
+  printf("%f", (end_time - start_time) / runs * 1000);
+  return 0;
+}
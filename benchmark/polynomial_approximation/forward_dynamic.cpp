@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+
+/* the degree and the gradient length are read from the command line */
+#include "../../forward_dynamic.h"
+
+/* the function to approximate */
+float f(float x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+dvar_t poly_eval(const dvar_t *P, size_t deg, float x) {
+  dvar_t val = P[0];
+  float X = x;
+  for (size_t i = 1; i < deg+1; i++) {
+    val += P[i] * X;
+    X *= x;
+  }
+  return val;
+}
+
+void poly_init(dvar_t *P, size_t deg, size_t grad_start, size_t grad_end) {
+  for (size_t i = 0; i < deg+1; ++i) {
+    P[i] = dvar_t(i+1);
+    if (i >= grad_start && i < grad_end) {
+      dvar_seed(&P[i], i - grad_start);
+    }
+  }
+}
+
+dvar_t reimann_integral(const dvar_t *P, size_t deg) {
+  dvar_t loss;
+
+  float step_size = (END-START) / N;
+  for (size_t j = 0; j < N; ++j) {
+    float x = START + j*step_size;
+    dvar_t delta = poly_eval(P, deg, x) - f(x);
+    loss = loss + (delta*delta) * step_size;
+  }
+
+  return loss;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    printf("usage: %s DEG GRADLEN\n", argv[0]);
+    return 1;
+  }
+  size_t deg = atoi(argv[1]);
+  size_t gradlen = atoi(argv[2]);
+  size_t runs = 10;
+  float start_time, end_time;
+
+  dgrad_pool_t *pool = dgrad_pool_create(gradlen);
+  dgrad_pool_load(pool);
+
+  start_time = (float) clock() / CLOCKS_PER_SEC;
+  for (size_t i = 0; i < runs; ++i) {
+    for (size_t grad_start = 0; grad_start < deg+1; grad_start += gradlen) {
+      dvar_t *P = new dvar_t[deg+1];
+      poly_init(P, deg, grad_start, grad_start + gradlen);
+      dvar_t loss = reimann_integral(P, deg);
+      delete[] P;
+    }
+  }
+  end_time = (float) clock() / CLOCKS_PER_SEC;
+
+  dgrad_pool_destroy(pool);
+
+  /* print average runtime in milliseconds */
+  printf("%f", (end_time - start_time) / runs * 1000);
+  return 0;
+}
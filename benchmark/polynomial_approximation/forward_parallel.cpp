@@ -3,8 +3,6 @@
 #include <strings.h>
 #include <math.h>
 #include <time.h>
-#include <pthread.h>
-#include <assert.h>
 
 const int N = 1000;  /* number of terms in the reimann sum */
 const float START = 0;  /* the start of the integration interval */
@@ -19,7 +17,7 @@ const int DEG = 4;  /* degree of the polynomial proximation */
 #ifndef GRADLEN
 #define GRADLEN 64
 #endif
-#include "../../forward.h"
+#include "../../forward_parallel.h"
 
 /* the function to approximate */
 float f(float x) {
@@ -27,7 +25,7 @@ float f(float x) {
   return exp(-1 / (x*x));
 }
 
-var_t poly_eval(var_t P[DEG+1], float x) {
+var_t poly_eval(const var_t P[DEG+1], float x) {
   var_t val = P[0];
   float X = x;
   for (size_t i = 1; i < DEG+1; i++) {
@@ -48,108 +46,76 @@ void poly_print(float P[DEG+1]) {
 #ifndef RI_WORKERS
 #define RI_WORKERS 2
 #endif
-const size_t RI_CHUNKS = ((DEG+1 + GRADLEN-1) / GRADLEN);
-
-typedef struct {
-  size_t start_chunk;
-  size_t end_chunk;
-  float *P;
-  float *grad;
-  float value;
-} ri_worker_param_t;
-
-void *ri_worker(void *param_ptr) {
-  ri_worker_param_t *param = (ri_worker_param_t *) param_ptr;
-
-  for (size_t chunk_id = param->start_chunk; chunk_id < param->end_chunk; ++chunk_id) {
-    var_t loss = {0};
-    var_t P[DEG+1] = {0};
-    for (size_t i = 0; i < DEG+1; ++i) {
-      P[i].value = param->P[i];
-      if (i >= chunk_id * GRADLEN && i < chunk_id * GRADLEN + GRADLEN) {
-        P[i].grad[i - chunk_id * GRADLEN] = 1;
-      }
-    }
-
-    float step_size = (END-START) / N;
-    for (size_t j = 0; j < N; ++j) {
-      float x = START + j*step_size;
-      var_t delta = poly_eval(P, x) - f(x);
-      loss = loss + (delta*delta) * step_size;
-      if (loss.value != loss.value) {
-
-      }
-    }
-
-    if (chunk_id == param->start_chunk) {
-      param->value = loss.value;
-    } else {
-      /* assert(param->value == loss.value); */
-    }
-    for (size_t i = 0; i < GRADLEN && chunk_id * GRADLEN + i < DEG+1; ++i) {
-      param->grad[chunk_id * GRADLEN + i] = loss.grad[i];
-    }
+
+var_t reimann_integral(const var_t *P, void *ctx) {
+  var_t loss = {0};
+
+  float step_size = (END-START) / N;
+  for (size_t j = 0; j < N; ++j) {
+    float x = START + j*step_size;
+    var_t delta = poly_eval(P, x) - f(x);
+    loss = loss + (delta*delta) * step_size;
   }
 
-  return NULL;
+  return loss;
+}
+
+#ifdef BENCH_TAIL
+int compare_float(const void *a, const void *b) {
+  float fa = *(const float *) a, fb = *(const float *) b;
+  return (fa > fb) - (fa < fb);
 }
 
-float reimann_integral(float P[DEG+1], float grad[DEG+1]) {
-  pthread_t worker_threads[RI_WORKERS];
-  ri_worker_param_t worker_params[RI_WORKERS];
-
-  assert(RI_CHUNKS > 0);
-  int handled_chunks = 0;
-  for (size_t worker_id = 0; worker_id < RI_WORKERS; ++worker_id) {
-    size_t start_chunk = (size_t) ((float) RI_CHUNKS / RI_WORKERS * worker_id);
-    size_t end_chunk = (size_t) ((float) RI_CHUNKS / RI_WORKERS * (worker_id+1));
-    worker_params[worker_id] = {
-      .start_chunk = start_chunk,
-      .end_chunk = end_chunk,
-      .P = P,
-      .grad = grad,
-    };
-    int err = pthread_create(&worker_threads[worker_id], NULL, &ri_worker, &worker_params[worker_id]);
-    if (err) {
-      printf("pthread_create error %d", err);
-      exit(1);
-      return 0;
-    }
-    handled_chunks += end_chunk - start_chunk;
+int main() {
+  const size_t runs = 200;
+  float runtimes[runs];
+  struct timespec start_time, end_time;
+
+  pool_t *pool = pool_create(RI_WORKERS);
+  forward_parallel_t *fp = forward_parallel_create(pool);
+
+  float P[DEG+1];
+  for (size_t i = 0; i < DEG+1; ++i) {
+    P[i] = i+1;
   }
-  assert(handled_chunks == RI_CHUNKS);
-
-  for (size_t worker_id = 0; worker_id < RI_WORKERS; ++worker_id) {
-    int err = pthread_join(worker_threads[worker_id], NULL);
-    if (err) {
-      printf("pthread_join error %d", err);
-      exit(1);
-      return err;
-    }
+  for (size_t i = 0; i < runs; ++i) {
+    float loss_grad[DEG+1];
+    /* wall clock time, clock() would sum the time of every worker */
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    float loss = forward_parallel_gradient(fp, &reimann_integral, NULL, P, DEG+1, loss_grad);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    runtimes[i] = ((end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) * 1e-9) * 1000;
   }
 
-  float value;
-  for (size_t worker_id = 1; worker_id < RI_WORKERS; ++worker_id) {
-    if (worker_params[worker_id].end_chunk - worker_params[worker_id].start_chunk > 0) {
-      value = worker_params[worker_id].value;
-    }
-  }
-  return value;
-}
+  forward_parallel_destroy(fp);
+  pool_destroy(pool);
 
+  /* print median, 99th percentile and max runtime in milliseconds */
+  qsort(runtimes, runs, sizeof(float), &compare_float);
+  printf("%f,%f,%f", runtimes[runs / 2], runtimes[runs * 99 / 100], runtimes[runs-1]);
+  return 0;
+}
+#else
 int main() {
   size_t runs = 10;
   float start_time, end_time;
 
+  pool_t *pool = pool_create(RI_WORKERS);
+  forward_parallel_t *fp = forward_parallel_create(pool);
+
   start_time = (float) clock() / CLOCKS_PER_SEC;
   for (size_t i = 0; i < runs; ++i) {
     float P[DEG+1];
     float loss_grad[DEG+1];
-    float loss = reimann_integral(P, loss_grad);
+    float loss = forward_parallel_gradient(fp, &reimann_integral, NULL, P, DEG+1, loss_grad);
   }
   end_time = (float) clock() / CLOCKS_PER_SEC;
 
+  forward_parallel_destroy(fp);
+  pool_destroy(pool);
+
   /* print average runtime in milliseconds */
   printf("%f", (end_time - start_time) / runs * 1000);
   return 0;
 }
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+/* the whole gradient is computed in one pass */
+#define GRADLEN (DEG+1)
+#include "../../forward.h"
+
+/* the function to approximate */
+double f(double x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+var_t poly_eval(var_t P[DEG+1], AD_REAL x) {
+  var_t val = P[0];
+  AD_REAL X = x;
+  for (size_t i = 1; i < DEG+1; i++) {
+    val += P[i] * X;
+    X *= x;
+  }
+  return val;
+}
+
+/* P[i] = 1/2^i keeps every term of the polynomial below 1 on [0, 2] */
+void poly_init(var_t P[DEG+1]) {
+  for (size_t i = 0; i < DEG+1; ++i) {
+    var_zero(&P[i]);
+    P[i].value = ldexp(1.0, -(int) i);
+    var_seed(&P[i], i);
+  }
+}
+
+var_t reimann_integral(var_t P[DEG+1]) {
+  var_t loss = {0};
+
+  AD_REAL step_size = (AD_REAL) (END-START) / N;
+  for (size_t j = 0; j < N; ++j) {
+    AD_REAL x = START + j*step_size;
+    var_t delta = poly_eval(P, x) - (AD_REAL) f(x);
+    loss = loss + (delta*delta) * step_size;
+  }
+
+  return loss;
+}
+
+/* the exact gradient of the reimann integral computed in double precision */
+void reimann_integral_grad(double grad[DEG+1]) {
+  double step_size = (double) (END-START) / N;
+  for (size_t i = 0; i < DEG+1; ++i) {
+    grad[i] = 0;
+  }
+  for (size_t j = 0; j < N; ++j) {
+    double x = START + j*step_size;
+    double delta = -f(x);
+    for (size_t i = 0; i < DEG+1; ++i) {
+      delta += ldexp(1.0, -(int) i) * pow(x, i);
+    }
+    for (size_t i = 0; i < DEG+1; ++i) {
+      grad[i] += 2 * delta * pow(x, i) * step_size;
+    }
+  }
+}
+
+int main() {
+  size_t runs = 10;
+  float start_time, end_time;
+  var_t loss;
+
+  start_time = (float) clock() / CLOCKS_PER_SEC;
+  for (size_t i = 0; i < runs; ++i) {
+    var_t P[DEG+1];
+    poly_init(P);
+    loss = reimann_integral(P);
+  }
+  end_time = (float) clock() / CLOCKS_PER_SEC;
+
+  /* relative error of the gradient in infinity norm */
+  double grad[DEG+1];
+  double max_error = 0, max_grad = 0;
+  reimann_integral_grad(grad);
+  for (size_t i = 0; i < DEG+1; ++i) {
+    max_error = fmax(max_error, fabs((double) (AD_REAL) loss.grad[i] - grad[i]));
+    max_grad = fmax(max_grad, fabs(grad[i]));
+  }
+
+  /* print average runtime in milliseconds and relative error */
+  printf("%f,%e", (end_time - start_time) / runs * 1000, max_error / max_grad);
+  return 0;
+}
@@ -20,15 +20,27 @@ float f(float x) {
   return exp(-1 / (x*x));
 }
 
+#ifdef FUSED
+/* a single dot product entry with the powers of x */
+var_t poly_eval(var_t P[DEG+1], float x) {
+  float X[DEG+1];
+  X[0] = 1;
+  for (size_t i = 1; i < DEG+1; i++) {
+    X[i] = X[i-1] * x;
+  }
+  return var_dot(P, X, DEG+1);
+}
+#else
 var_t poly_eval(var_t P[DEG+1], float x) {
   var_t val = P[0];
   float X = x;
   for (size_t i = 1; i < DEG+1; i++) {
-    val = val + P[i] * var_create(X);
+    val = val + P[i] * X;
     X *= x;
   }
   return val;
 }
+#endif
 
 void poly_init(var_t P[DEG+1]) {
   for (size_t i = 0; i < DEG+1; ++i) {
@@ -37,16 +49,35 @@ void poly_init(var_t P[DEG+1]) {
 }
 
 var_t reimann_integral(var_t P[DEG+1]) {
+#ifdef FUSED
+  static var_t terms[N];
+#else
   var_t loss = var_create(0);
+#endif
 
   float step_size = (END-START)/N;
   for (size_t j = 0; j < N; ++j) {
     float x = START + j*step_size;
-    var_t delta = poly_eval(P, x) - var_create(f(x));
-    loss = loss + (delta*delta) * var_create(step_size);
+#ifdef PREACC
+    /* each term is a single entry whose parents are the coefficients */
+    tape_mark_t mark = tape_mark();
+    var_t delta = poly_eval(P, x) - f(x);
+    var_t term = var_preaccumulate(mark, (delta*delta) * step_size);
+    loss = loss + term;
+#elif defined(FUSED)
+    var_t delta = poly_eval(P, x) - f(x);
+    terms[j] = (delta*delta) * step_size;
+#else
+    var_t delta = poly_eval(P, x) - f(x);
+    loss = loss + (delta*delta) * step_size;
+#endif
   }
 
+#ifdef FUSED
+  return var_sum(terms, N);
+#else
   return loss;
+#endif
 }
 
 int main() {
@@ -60,6 +91,7 @@ int main() {
     tape_load(tape);
     poly_init(P);
     var_t loss = reimann_integral(P);
+    tape_reverse_pass(tape, loss);
     tape_destroy(tape);
   }
   end_time = (float) clock() / CLOCKS_PER_SEC;
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+#include "../../reverse_checkpoint.h"
+
+/* the function to approximate */
+float f(float x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+var_t poly_eval(const var_t P[DEG+1], float x) {
+  var_t val = P[0];
+  float X = x;
+  for (size_t i = 1; i < DEG+1; i++) {
+    val = val + P[i] * X;
+    X *= x;
+  }
+  return val;
+}
+
+/* term `j` of the reimann sum */
+var_t reimann_term(const var_t P[DEG+1], size_t j) {
+  float step_size = (END-START)/N;
+  float x = START + j*step_size;
+  var_t delta = poly_eval(P, x) - f(x);
+  return (delta*delta) * step_size;
+}
+
+/*
+ * the reimann sum as N time steps, the state is the polynomial followed by
+ * the partial sum and step `j` adds term `j` to the partial sum
+ */
+void reimann_step(var_t *state, size_t j, void *ctx) {
+  state[DEG+1] = state[DEG+1] + reimann_term(state, j);
+}
+
+var_t reimann_loss(const var_t *state, void *ctx) {
+  return state[DEG+1];
+}
+
+/* seconds elapsed since `start` */
+double elapsed(struct timespec start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*
+ * print the average runtime in milliseconds of the gradient of the reimann sum
+ * recorded on a single tape, of the one computed with `argv[1]` checkpoints,
+ * and the relative difference of the two gradients in infinity norm
+ */
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf("usage: %s CHECKPOINTS\n", argv[0]);
+    return 1;
+  }
+  size_t n_checkpoints = strtoull(argv[1], NULL, 10);
+  size_t runs = 10;
+  struct timespec start_time;
+
+  float initial_state[DEG+2];
+  float tape_grad[DEG+1], checkpoint_grad[DEG+2];
+  for (size_t i = 0; i < DEG+1; ++i) {
+    initial_state[i] = i+1;
+  }
+  initial_state[DEG+1] = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    var_t P[DEG+1];
+    tape_t *tape = tape_create(64);
+    tape_load(tape);
+    for (size_t k = 0; k < DEG+1; ++k) {
+      P[k] = var_create(initial_state[k]);
+    }
+    var_t loss = var_create(0);
+    for (size_t j = 0; j < N; ++j) {
+      loss = loss + reimann_term(P, j);
+    }
+    tape_reverse_pass(tape, loss);
+    for (size_t k = 0; k < DEG+1; ++k) {
+      tape_grad[k] = var_adjoint(P[k]);
+    }
+    tape_destroy(tape);
+  }
+  double tape_time = elapsed(start_time) / runs;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    checkpoint_gradient(&reimann_step, &reimann_loss, NULL, initial_state, DEG+2,
+                        N, n_checkpoints, checkpoint_grad);
+  }
+  double checkpoint_time = elapsed(start_time) / runs;
+
+  double max_error = 0, max_grad = 0;
+  for (size_t k = 0; k < DEG+1; ++k) {
+    max_error = fmax(max_error, fabs(checkpoint_grad[k] - tape_grad[k]));
+    max_grad = fmax(max_grad, fabs(tape_grad[k]));
+  }
+
+  printf("%f,%f,%e", tape_time * 1000, checkpoint_time * 1000, max_error / max_grad);
+  return 0;
+}
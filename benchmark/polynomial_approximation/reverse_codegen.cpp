@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+#include "../../reverse_codegen.h"
+
+/* the function to approximate */
+float f(float x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+var_t poly_eval(var_t P[DEG+1], float x) {
+  var_t val = P[0];
+  float X = x;
+  for (size_t i = 1; i < DEG+1; i++) {
+    val = val + P[i] * X;
+    X *= x;
+  }
+  return val;
+}
+
+void poly_init(var_t P[DEG+1]) {
+  for (size_t i = 0; i < DEG+1; ++i) {
+    P[i] = var_create(i+1);
+  }
+}
+
+var_t reimann_integral(var_t P[DEG+1]) {
+  var_t loss = var_create(0);
+
+  float step_size = (END-START)/N;
+  for (size_t j = 0; j < N; ++j) {
+    float x = START + j*step_size;
+    var_t delta = poly_eval(P, x) - f(x);
+    loss = loss + (delta*delta) * step_size;
+  }
+
+  return loss;
+}
+
+/* write to stdout the generated function computing the loss and its gradient */
+int main() {
+  var_t P[DEG+1];
+  tape_t *tape = tape_create(64);
+  tape_load(tape);
+  poly_init(P);
+  var_t loss = reimann_integral(P);
+  codegen_write(stdout, "loss_grad", tape, P, DEG+1, loss);
+  tape_destroy(tape);
+  return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+/* the kernel written by reverse_codegen.cpp for the same DEG */
+#include KERNEL
+
+int main() {
+  size_t runs = 10;
+  float start_time, end_time;
+  float P[DEG+1], grad[DEG+1];
+
+  start_time = (float) clock() / CLOCKS_PER_SEC;
+  for (size_t i = 0; i < runs; ++i) {
+    for (size_t j = 0; j < DEG+1; ++j)
+      P[j] = j+1;
+    loss_grad(P, grad);
+  }
+  end_time = (float) clock() / CLOCKS_PER_SEC;
+
+  /* print average runtime in milliseconds */
+  printf("%f", (end_time - start_time) / runs * 1000);
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+#include "../../reverse_hvp.h"
+
+/* the function to approximate */
+double f(double x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+var_t poly_eval(const var_t P[DEG+1], AD_REAL x) {
+  var_t val = P[0];
+  AD_REAL X = x;
+  for (size_t i = 1; i < DEG+1; i++) {
+    val = val + P[i] * X;
+    X *= x;
+  }
+  return val;
+}
+
+/*
+ * a pseudo-Huber loss of the error of the polynomial, unlike the squares of
+ * the reimann sum its Hessian depends on P
+ */
+var_t huber_integral(const var_t P[DEG+1]) {
+  var_t loss = var_create(0);
+
+  AD_REAL step_size = (AD_REAL) (END-START) / N;
+  for (size_t j = 0; j < N; ++j) {
+    AD_REAL x = START + j*step_size;
+    var_t delta = poly_eval(P, x) - f(x);
+    loss = loss + (var_sqrt(delta*delta + 1) - 1) * step_size;
+  }
+
+  return loss;
+}
+
+/* record the loss at `values` and store its gradient in `grad` */
+void huber_grad(const AD_REAL values[DEG+1], AD_REAL grad[DEG+1]) {
+  var_t P[DEG+1];
+  tape_t *tape = tape_create(64);
+  tape_load(tape);
+  for (size_t i = 0; i < DEG+1; ++i) {
+    P[i] = var_create(values[i]);
+  }
+  var_t loss = huber_integral(P);
+  tape_reverse_pass(tape, loss);
+  for (size_t i = 0; i < DEG+1; ++i) {
+    grad[i] = var_adjoint(P[i]);
+  }
+  tape_destroy(tape);
+}
+
+/* seconds elapsed since `start` */
+double elapsed(struct timespec start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*
+ * print the average runtime in milliseconds of the gradient of the loss, of
+ * its Hessian-vector product, and the relative difference in infinity norm of
+ * the Hessian-vector product with central finite differences of gradients
+ */
+int main() {
+  size_t runs = 10;
+  struct timespec start_time;
+
+  /*
+   * P[i] = 1/2^i keeps every term of the polynomial below 1 on [0, 2], so does
+   * the direction, which moves each coefficient in proportion to its value
+   */
+  AD_REAL values[DEG+1], direction[DEG+1];
+  AD_REAL grad[DEG+1], hv[DEG+1];
+  for (size_t i = 0; i < DEG+1; ++i) {
+    values[i] = ldexp(1.0, -(int) i);
+    direction[i] = values[i];
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    huber_grad(values, grad);
+  }
+  double grad_time = elapsed(start_time) / runs;
+
+  hvp_t *hvp = hvp_create();
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    var_t P[DEG+1];
+    tape_t *tape = tape_create(64);
+    tape_load(tape);
+    for (size_t k = 0; k < DEG+1; ++k) {
+      P[k] = var_create(values[k]);
+    }
+    var_t loss = huber_integral(P);
+    hvp_pass(hvp, tape, loss, P, direction, DEG+1);
+    for (size_t k = 0; k < DEG+1; ++k) {
+      hv[k] = hvp_value(hvp, P[k]);
+    }
+    tape_destroy(tape);
+  }
+  double hvp_time = elapsed(start_time) / runs;
+  hvp_destroy(hvp);
+
+  /* the step balances the truncation error and the rounding error */
+  AD_REAL h = sizeof(AD_REAL) > sizeof(float) ? 1e-5 : 1e-2;
+  AD_REAL shifted[DEG+1], grad_plus[DEG+1], grad_minus[DEG+1];
+  for (size_t k = 0; k < DEG+1; ++k) {
+    shifted[k] = values[k] + h * direction[k];
+  }
+  huber_grad(shifted, grad_plus);
+  for (size_t k = 0; k < DEG+1; ++k) {
+    shifted[k] = values[k] - h * direction[k];
+  }
+  huber_grad(shifted, grad_minus);
+
+  double max_error = 0, max_hv = 0;
+  for (size_t k = 0; k < DEG+1; ++k) {
+    double finite_difference = (grad_plus[k] - grad_minus[k]) / (2 * h);
+    max_error = fmax(max_error, fabs(hv[k] - finite_difference));
+    max_hv = fmax(max_hv, fabs(hv[k]));
+  }
+
+  printf("%f,%f,%e", grad_time * 1000, hvp_time * 1000, max_error / max_hv);
+  return 0;
+}
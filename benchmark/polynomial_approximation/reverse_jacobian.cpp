@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+#include "../../reverse_jacobian.h"
+
+/* the function to approximate */
+float f(float x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+var_t poly_eval(const var_t P[DEG+1], float x) {
+  var_t val = P[0];
+  float X = x;
+  for (size_t i = 1; i < DEG+1; i++) {
+    val = val + P[i] * X;
+    X *= x;
+  }
+  return val;
+}
+
+/* the residuals of the reimann sum, a function of DEG+1 inputs and N outputs */
+void residuals(const var_t *P, var_t *outputs, void *ctx) {
+  float step_size = (END-START)/N;
+  for (size_t j = 0; j < N; ++j) {
+    float x = START + j*step_size;
+    outputs[j] = poly_eval(P, x) - f(x);
+  }
+}
+
+/* seconds elapsed since `start` */
+double elapsed(struct timespec start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/* average seconds of a Jacobian computed in `mode`, recording included */
+double jacobian_time(jacobian_mode_t mode, const float *P, float *values, float *jac) {
+  struct timespec start_time;
+  size_t runs = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  do {
+    jacobian_with_mode(mode, &residuals, NULL, P, DEG+1, N, values, jac);
+    ++runs;
+  } while (elapsed(start_time) < 0.5);
+  return elapsed(start_time) / runs;
+}
+
+/*
+ * measure the cost of an entry of a forward sweep and of a reverse sweep of
+ * `reverse_jacobian.h` and print them as the compiler flags that set them
+ */
+int main() {
+  float P[DEG+1];
+  static float values[N], jac[N * (DEG+1)];
+  for (size_t i = 0; i < DEG+1; ++i) {
+    P[i] = i+1;
+  }
+
+  /* time of the recording alone, and entries of the sweeps */
+  struct timespec start_time;
+  size_t runs = 0;
+  var_t vars[DEG+1], outputs[N];
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  do {
+    tape_t *tape = tape_create(64);
+    tape_load(tape);
+    for (size_t i = 0; i < DEG+1; ++i)
+      vars[i] = var_create(P[i]);
+    residuals(vars, outputs, NULL);
+    tape_destroy(tape);
+    ++runs;
+  } while (elapsed(start_time) < 0.5);
+  double record_time = elapsed(start_time) / runs;
+  double forward_entries = jacobian_forward_entries(outputs, DEG+1, N);
+  double reverse_entries = jacobian_reverse_entries(outputs, N);
+
+  double forward_time = jacobian_time(JACOBIAN_FORWARD, P, values, jac);
+  double reverse_time = jacobian_time(JACOBIAN_REVERSE, P, values, jac);
+
+  printf("-DJACOBIAN_FORWARD_COST=%.3f -DJACOBIAN_REVERSE_COST=%.3f",
+         (forward_time - record_time) / forward_entries * 1e9,
+         (reverse_time - record_time) / reverse_entries * 1e9);
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1 << 20;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+#ifndef RI_WORKERS
+#define RI_WORKERS 2
+#endif
+#include "../../reverse_levels.h"
+#include "../../reverse_replay.h"
+
+/* the function to approximate */
+float f(float x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+var_t poly_eval(var_t P[DEG+1], float x) {
+  float X[DEG+1];
+  X[0] = 1;
+  for (size_t i = 1; i < DEG+1; i++) {
+    X[i] = X[i-1] * x;
+  }
+  return var_dot(P, X, DEG+1);
+}
+
+/* the terms are independent, they only meet in the final sum */
+var_t reimann_integral(var_t P[DEG+1]) {
+  static var_t terms[N];
+  float step_size = (END-START)/N;
+  for (size_t j = 0; j < N; ++j) {
+    float x = START + j*step_size;
+    var_t delta = poly_eval(P, x) - f(x);
+    terms[j] = (delta*delta) * step_size;
+  }
+  return var_sum(terms, N);
+}
+
+/* seconds elapsed since `start` */
+double elapsed(struct timespec start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*
+ * record the reimann sum once and print the average runtime in milliseconds of
+ * the reverse pass on one thread, of the levelized one on RI_WORKERS and of the
+ * levelized one on the tape of a replay, whose levels are contiguous
+ */
+int main() {
+  size_t runs = 10;
+  struct timespec start_time;
+
+  var_t P[DEG+1];
+  tape_t *tape = tape_create(64);
+  tape_load(tape);
+  for (size_t i = 0; i < DEG+1; ++i) {
+    P[i] = var_create(i+1);
+  }
+  var_t loss = reimann_integral(P);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    tape_reverse_pass(tape, loss);
+  }
+  double serial_time = elapsed(start_time) / runs;
+
+  pool_t *pool = pool_create(RI_WORKERS);
+  levels_t *levels = levels_create(tape);
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    levels_reverse_pass(levels, pool, tape, loss);
+  }
+  double levels_time = elapsed(start_time) / runs;
+  levels_destroy(levels);
+
+  replay_t *replay = replay_create(tape);
+  var_t replay_loss = {replay_index(replay, loss)};
+  levels = levels_create(replay->tape);
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    levels_reverse_pass(levels, pool, replay->tape, replay_loss);
+  }
+  double replay_time = elapsed(start_time) / runs;
+
+  levels_destroy(levels);
+  replay_destroy(replay);
+  pool_destroy(pool);
+  tape_destroy(tape);
+  printf("%f,%f,%f", serial_time * 1000, levels_time * 1000, replay_time * 1000);
+  return 0;
+}
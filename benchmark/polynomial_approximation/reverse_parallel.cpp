@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+
+const int N = 1000;  /* number of terms in the reimann sum */
+const float START = 0;  /* the start of the integration interval */
+const float END = 2;  /* the end of the integration interval */
+#ifndef DEG
+#warning "DEG set to default value 4"
+const int DEG = 4;  /* degree of the polynomial proximation */
+#endif
+
+#ifndef RI_WORKERS
+#define RI_WORKERS 2
+#endif
+#include "../../reverse_parallel.h"
+
+/* the function to approximate */
+float f(float x) {
+  if (x == 0) return 0;
+  return exp(-1 / (x*x));
+}
+
+var_t poly_eval(const var_t P[DEG+1], float x) {
+  var_t val = P[0];
+  float X = x;
+  for (size_t i = 1; i < DEG+1; i++) {
+    val = val + P[i] * X;
+    X *= x;
+  }
+  return val;
+}
+
+/* one term of the reimann sum */
+var_t reimann_term(const var_t *P, size_t j, void *ctx) {
+  float step_size = (END-START)/N;
+  float x = START + j*step_size;
+  var_t delta = poly_eval(P, x) - f(x);
+  return (delta*delta) * step_size;
+}
+
+int main() {
+  size_t runs = 10;
+  struct timespec start_time, end_time;
+
+  float P[DEG+1];
+  float loss_grad[DEG+1];
+  for (size_t i = 0; i < DEG+1; ++i) {
+    P[i] = i+1;
+  }
+
+  pool_t *pool = pool_create(RI_WORKERS);
+  reverse_parallel_t *rp = reverse_parallel_create(pool);
+
+  /* wall clock time, clock() would sum the time of every worker */
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (size_t i = 0; i < runs; ++i) {
+    float loss = reverse_parallel_gradient(rp, &reimann_term, NULL, P, DEG+1, N, loss_grad);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+  reverse_parallel_destroy(rp);
+  pool_destroy(pool);
+
+  /* print average runtime in milliseconds */
+  float elapsed = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) * 1e-9;
+  printf("%f", elapsed / runs * 1000);
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../../reverse.h"
+
+/* seconds elapsed since `start` */
+double elapsed(struct timespec start) {
+  struct timespec end;
+  /* wall clock time, clock() would not count the time waiting for the disk */
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/*
+ * record a tape of about `argv[1]` entries, then run the reverse pass and
+ * print "entries,recorded entries per second,reversed entries per second"
+ */
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf("usage: %s ENTRIES\n", argv[0]);
+    return 1;
+  }
+  size_t entries = strtoull(argv[1], NULL, 10);
+  struct timespec start_time;
+
+  tape_t *tape = tape_create(64);
+  tape_load(tape);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  var_t x = var_create(1);
+  var_t acc = var_create(0);
+  for (size_t i = 0; i < entries / 2; ++i) {
+    acc = acc * 0.5f + x;
+  }
+  double record_time = elapsed(start_time);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  tape_reverse_pass(tape, acc);
+  double reverse_time = elapsed(start_time);
+
+  if (fabs(var_adjoint(x) - 2) > 1e-3) {
+    printf("wrong adjoint %f\n", var_adjoint(x));
+    return 1;
+  }
+  printf("%u,%f,%f", tape->length, tape->length / record_time, tape->length / reverse_time);
+  tape_destroy(tape);
+  return 0;
+}
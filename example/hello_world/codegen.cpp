@@ -0,0 +1,17 @@
+#include <stdio.h>
+#include "../../reverse_codegen.h"
+
+/* write to stdout the generated function computing the hello world gradient */
+int main() {
+  tape_t *tape = tape_create(64);
+  tape_load(tape);
+
+  var_t inputs[4] = {var_create(4), var_create(9), var_create(7), var_create(-2)};
+  var_t a = inputs[0], b = inputs[1], c = inputs[2], d = inputs[3];
+
+  var_t e = var_pow(var_sqrt(a / (b + c * a) + var_exp(1 / d)), -3);
+  codegen_write(stdout, "hello_world_grad", tape, inputs, 4, e);
+
+  tape_destroy(tape);
+  return 0;
+}
@@ -4,10 +4,22 @@
 #include "../../forward.h"
 
 int main() {
-  var_t a = {.grad = {1, 0, 0, 0}, .value = 4};
-  var_t b = {.grad = {0, 1, 0, 0}, .value = 9};
-  var_t c = {.grad = {0, 0, 1, 0}, .value = 7};
-  var_t d = {.grad = {0, 0, 0, 1}, .value = -2};
+  var_t a;
+  var_zero(&a);
+  a.value = 4;
+  var_seed(&a, 0);
+  var_t b;
+  var_zero(&b);
+  b.value = 9;
+  var_seed(&b, 1);
+  var_t c;
+  var_zero(&c);
+  c.value = 7;
+  var_seed(&c, 2);
+  var_t d;
+  var_zero(&d);
+  d.value = -2;
+  var_seed(&d, 3);
 
   var_t e = var_pow(var_sqrt(a / (b + c * a) + var_exp(1 / d)), -3);
   printf("value: %f\n", e.value);
@@ -0,0 +1,12 @@
+#include <stdio.h>
+#include "generated_kernel.h"
+
+int main() {
+  float inputs[4] = {4, 9, 7, -2};
+  float grad[4];
+
+  float e = hello_world_grad(inputs, grad);
+  printf("value: %f\n", e);
+  printf("grad: {%f, %f, %f, %f}\n", grad[0], grad[1], grad[2], grad[3]);
+  return 0;
+}
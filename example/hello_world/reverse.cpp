@@ -10,7 +10,7 @@ int main() {
   var_t c = var_create(7);
   var_t d = var_create(-2);
 
-  var_t e = var_pow(var_sqrt(a / (b + c * a) + var_exp(var_create(1) / d)), -var_create(3));
+  var_t e = var_pow(var_sqrt(a / (b + c * a) + var_exp(1 / d)), -3);
   tape_reverse_pass(tape, e);
   printf("value: %f\n", var_value(e));
   printf("grad: {%f, %f, %f, %f}\n", var_adjoint(a), var_adjoint(b), var_adjoint(c), var_adjoint(d));
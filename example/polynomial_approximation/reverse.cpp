@@ -23,7 +23,7 @@ var_t poly_eval(var_t P[DEG+1], float x) {
   var_t val = P[0];
   float X = x;
   for (size_t i = 1; i < DEG+1; i++) {
-    val += P[i] * var_create(X);
+    val += P[i] * X;
     X *= x;
   }
   return val;
@@ -49,8 +49,8 @@ var_t reimann_integral(var_t P[DEG+1]) {
   float step_size = (END-START) / N;
   for (size_t j = 0; j < N; ++j) {
     float x = START + j*step_size;
-    var_t delta = poly_eval(P, x) - var_create(f(x));
-    loss = loss + (delta*delta) * var_create(step_size);
+    var_t delta = poly_eval(P, x) - f(x);
+    loss = loss + (delta*delta) * step_size;
   }
 
   return loss;
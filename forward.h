@@ -6,27 +6,48 @@
  * differentiation using operator overloading on a custom `var_t` type.
  *
  * Each `var_t` variable holds:
- *  - `value`: the scalar value of the variable.
+ *  - `value`: the scalar value of the variable (of type `AD_REAL`).
  *  - `grad[GRADLEN]`: a gradient vector representing the derivative of the
  *    variable with respect to each input in a vector of size `GRADLEN`.
  *
  * Usage Example:
  * ----------------------------------------------------------------------------
  * To compute ∂f/∂x and ∂f/∂y for f(x, y) = sin(x) + y²:
- *   var_t x = {.value = 1.0}; x.grad[0] = 1; // ∂x/∂x = 1
- *   var_t y = {.value = 2.0}; y.grad[1] = 1; // ∂y/∂y = 1
+ *   var_t x = {.value = 1.0}; var_seed(&x, 0); // ∂x/∂x = 1
+ *   var_t y = {.value = 2.0}; var_seed(&y, 1); // ∂y/∂y = 1
  *   var_t f = var_sin(x) + var_pow(y, 2);
  *   // f.value holds the result, f.grad[0] is ∂f/∂x, f.grad[1] is ∂f/∂y
  *
  * Notes:
  * ----------------------------------------------------------------------------
  *  - The macro `GRADLEN` must be defined before including this header.
+ *  - Define `GRADMASK` to track which gradient lanes may be non zero, so that
+ *    operations on variables that depend on few inputs only touch those lanes.
+ *    Operations fall back to looping over every lane once more than
+ *    `GRADMASK_DENSE` lanes are active. In this mode, inputs must be seeded
+ *    with `var_seed` rather than by writing to `grad` directly.
+ *  - Define `AD_REAL` (default `float`) to change the type of the values and
+ *    of the derivative arithmetic, e.g. `double`. Define `GRAD_STORAGE` to
+ *    store the gradient lanes in a narrower type such as `bf16_t` or
+ *    `_Float16`, each lane is then converted to `AD_REAL` when computed on.
+ *  - Define `GRADSIMD` to compute the gradients with explicit SSE, AVX or
+ *    AVX-512 kernels (picked from the target flags, e.g. `-march=native`)
+ *    rather than relying on auto-vectorization. `grad` is then aligned and
+ *    padded to a multiple of the vector length, heap allocated variables must
+ *    be aligned to `alignof(var_t)`.
+ *  - Define `GRADEXPR` to build expression templates rather than variables:
+ *    the gradient of a compound expression such as `a + (b*b) * 2` is then
+ *    computed by a single loop when the expression is assigned to a `var_t`,
+ *    instead of one loop and one temporary gradient per operation. Expressions
+ *    refer to their operands, they must not be stored (e.g. with `auto`) but
+ *    assigned to a `var_t` in the statement that builds them.
  */
 
 #ifndef H_AUTODIFF
 #define H_AUTODIFF
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
@@ -38,11 +59,126 @@
 #define GRADLEN 0
 #endif
 
+/* type of the values and of the arithmetic on the gradients */
+#ifndef AD_REAL
+#define AD_REAL float
+#endif
+
+/*
+ * bfloat16 storage type: the upper half of a float, converted to and from float
+ * on each access so that the arithmetic stays in `AD_REAL`
+ */
+struct bf16_t {
+  uint16_t bits;
+
+  bf16_t() = default;
+
+  bf16_t(float x) {
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    u += 0x7fff + ((u >> 16) & 1);  /* round to nearest even */
+    bits = (uint16_t) (u >> 16);
+  }
+
+  operator float() const {
+    uint32_t u = (uint32_t) bits << 16;
+    float x;
+    memcpy(&x, &u, sizeof(x));
+    return x;
+  }
+};
+
+/*
+ * type of the gradient lanes in memory, a narrower type than `AD_REAL` (e.g.
+ * `bf16_t` or `_Float16`) halves the memory traffic of wide gradients
+ */
+#ifndef GRAD_STORAGE
+#define GRAD_STORAGE AD_REAL
+#endif
+
+#if defined(GRADEXPR) && (defined(GRADMASK) || defined(GRADSIMD))
+#error "GRADEXPR can not be combined with GRADMASK nor GRADSIMD"
+#endif
+
+#ifdef GRADSIMD
+
+#include <immintrin.h>
+
+/*
+ * explicit SIMD gradient kernels, the instruction set is selected at compile
+ * time from the target flags (e.g. -march=native)
+ */
+#if defined(__AVX512F__)
+#define GRAD_VECLEN 16
+typedef __m512 grad_vec_t;
+#elif defined(__AVX__)
+#define GRAD_VECLEN 8
+typedef __m256 grad_vec_t;
+#elif defined(__SSE__)
+#define GRAD_VECLEN 4
+typedef __m128 grad_vec_t;
+#else
+#error "GRADSIMD requires SSE, AVX or AVX-512"
+#endif
+
+static_assert(sizeof(AD_REAL) == sizeof(float) && sizeof(GRAD_STORAGE) == sizeof(float),
+              "GRADSIMD requires float values and gradients");
+
+/*
+ * the gradient is padded to a multiple of the vector length and aligned so that
+ * the kernels never need a scalar tail or an unaligned load. The kernels load,
+ * compute on and store the padding lanes like the others, they are zeroed by
+ * `var_zero`, stay zero as long as the factors are finite, and are never
+ * returned. `var_zero` must keep clearing them, garbage in them could raise
+ * floating point exceptions.
+ */
+#define GRADLEN_STORAGE ((GRADLEN + GRAD_VECLEN-1) / GRAD_VECLEN * GRAD_VECLEN)
+#define GRAD_ALIGNAS alignas(GRAD_VECLEN * sizeof(float))
+
+#else
+
+#define GRADLEN_STORAGE GRADLEN
+#define GRAD_ALIGNAS
+
+#endif
+
+#ifdef GRADMASK
+
+/* number of 64 bit words of the activity mask */
+#define GRADMASK_WORDS ((GRADLEN + 63) / 64)
+
+/* above this number of active lanes, operations loop over every lane */
+#ifndef GRADMASK_DENSE
+#define GRADMASK_DENSE (GRADLEN / 4)
+#endif
+
 typedef struct {
-  float grad[GRADLEN];
-  float value;
+  GRAD_ALIGNAS GRAD_STORAGE grad[GRADLEN_STORAGE];
+  AD_REAL value;
+  uint64_t mask[GRADMASK_WORDS];  /* bit i is set if grad[i] may be non zero */
 } var_t;
 
+#else
+
+#ifdef GRADEXPR
+/* expression node of a variable or of an expression, see `expr_eval` */
+template<class T> struct expr_of;
+#endif
+
+typedef struct {
+  GRAD_ALIGNAS GRAD_STORAGE grad[GRADLEN_STORAGE];
+  AD_REAL value;
+#ifdef GRADEXPR
+  /* evaluate the expression `e` into this variable in a single loop */
+  template<class E, class = typename expr_of<E>::type>
+  void operator=(const E &e) {
+    expr_eval(*this, e);
+  }
+#endif
+} var_t;
+
+#endif
+
 /*
  * initialize an new variable that does not derive from the input vector (see
  * above description)
@@ -51,154 +187,463 @@ static void var_zero(var_t *a) {
   memset(a, 0, sizeof(*a));
 }
 
+/* set ∂a/∂x = 1 where x is the input associated with gradient lane `lane` */
+static void var_seed(var_t *a, size_t lane) {
+  assert(lane < GRADLEN);
+  a->grad[lane] = 1;
+#ifdef GRADMASK
+  a->mask[lane / 64] |= (uint64_t) 1 << (lane % 64);
+#endif
+}
+
+/* dense gradient kernels, they loop over every lane */
+#ifdef GRADSIMD
+
+#if GRAD_VECLEN == 16
+
+static inline grad_vec_t grad_vec_load(const float *p) { return _mm512_load_ps(p); }
+static inline void grad_vec_store(float *p, grad_vec_t v) { _mm512_store_ps(p, v); }
+static inline grad_vec_t grad_vec_set1(float x) { return _mm512_set1_ps(x); }
+static inline grad_vec_t grad_vec_mul(grad_vec_t a, grad_vec_t b) { return _mm512_mul_ps(a, b); }
+static inline grad_vec_t grad_vec_fmadd(grad_vec_t a, grad_vec_t b, grad_vec_t c) { return _mm512_fmadd_ps(a, b, c); }
+
+#elif GRAD_VECLEN == 8
+
+static inline grad_vec_t grad_vec_load(const float *p) { return _mm256_load_ps(p); }
+static inline void grad_vec_store(float *p, grad_vec_t v) { _mm256_store_ps(p, v); }
+static inline grad_vec_t grad_vec_set1(float x) { return _mm256_set1_ps(x); }
+static inline grad_vec_t grad_vec_mul(grad_vec_t a, grad_vec_t b) { return _mm256_mul_ps(a, b); }
+#ifdef __FMA__
+static inline grad_vec_t grad_vec_fmadd(grad_vec_t a, grad_vec_t b, grad_vec_t c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+static inline grad_vec_t grad_vec_fmadd(grad_vec_t a, grad_vec_t b, grad_vec_t c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+#else
+
+static inline grad_vec_t grad_vec_load(const float *p) { return _mm_load_ps(p); }
+static inline void grad_vec_store(float *p, grad_vec_t v) { _mm_store_ps(p, v); }
+static inline grad_vec_t grad_vec_set1(float x) { return _mm_set1_ps(x); }
+static inline grad_vec_t grad_vec_mul(grad_vec_t a, grad_vec_t b) { return _mm_mul_ps(a, b); }
+#ifdef __FMA__
+static inline grad_vec_t grad_vec_fmadd(grad_vec_t a, grad_vec_t b, grad_vec_t c) { return _mm_fmadd_ps(a, b, c); }
+#else
+static inline grad_vec_t grad_vec_fmadd(grad_vec_t a, grad_vec_t b, grad_vec_t c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+#endif
+
+#endif
+
+/* a = alpha * a */
+static inline void grad_scale_lanes(float *a, float alpha) {
+  grad_vec_t valpha = grad_vec_set1(alpha);
+  for (size_t i = 0; i < GRADLEN_STORAGE; i += GRAD_VECLEN)
+    grad_vec_store(a + i, grad_vec_mul(valpha, grad_vec_load(a + i)));
+}
+
+/* a = alpha * a + beta * b */
+static inline void grad_axpby_lanes(float *a, float alpha, const float *b, float beta) {
+  grad_vec_t valpha = grad_vec_set1(alpha);
+  grad_vec_t vbeta = grad_vec_set1(beta);
+  for (size_t i = 0; i < GRADLEN_STORAGE; i += GRAD_VECLEN) {
+    grad_vec_t vb = grad_vec_mul(vbeta, grad_vec_load(b + i));
+    grad_vec_store(a + i, grad_vec_fmadd(valpha, grad_vec_load(a + i), vb));
+  }
+}
+
+#else
+
+/* a = alpha * a */
+static inline void grad_scale_lanes(GRAD_STORAGE *a, AD_REAL alpha) {
+  for (size_t i = 0; i < GRADLEN; i++)
+    a[i] = alpha * a[i];
+}
+
+/* a = alpha * a + beta * b */
+static inline void grad_axpby_lanes(GRAD_STORAGE *a, AD_REAL alpha, const GRAD_STORAGE *b, AD_REAL beta) {
+  for (size_t i = 0; i < GRADLEN; i++)
+    a[i] = alpha * a[i] + beta * b[i];
+}
+
+#endif
+
+/*
+ * gradient kernels, every operation below updates the gradient of its result
+ * with one of those two
+ */
+#ifdef GRADMASK
+
+static inline size_t grad_active(const uint64_t mask[GRADMASK_WORDS]) {
+  size_t active = 0;
+  for (size_t w = 0; w < GRADMASK_WORDS; w++)
+    active += __builtin_popcountll(mask[w]);
+  return active;
+}
+
+/* a.grad = alpha * a.grad */
+static inline void grad_scale(var_t &a, AD_REAL alpha) {
+  if (grad_active(a.mask) > GRADMASK_DENSE) {
+    grad_scale_lanes(a.grad, alpha);
+    return;
+  }
+  for (size_t w = 0; w < GRADMASK_WORDS; w++) {
+    for (uint64_t m = a.mask[w]; m; m &= m - 1) {
+      size_t i = w * 64 + __builtin_ctzll(m);
+      a.grad[i] = alpha * a.grad[i];
+    }
+  }
+}
+
+/* a.grad = alpha * a.grad + beta * b.grad */
+static inline void grad_axpby(var_t &a, AD_REAL alpha, const var_t &b, AD_REAL beta) {
+  for (size_t w = 0; w < GRADMASK_WORDS; w++)
+    a.mask[w] |= b.mask[w];
+  if (grad_active(a.mask) > GRADMASK_DENSE) {
+    grad_axpby_lanes(a.grad, alpha, b.grad, beta);
+    return;
+  }
+  for (size_t w = 0; w < GRADMASK_WORDS; w++) {
+    for (uint64_t m = a.mask[w]; m; m &= m - 1) {
+      size_t i = w * 64 + __builtin_ctzll(m);
+      a.grad[i] = alpha * a.grad[i] + beta * b.grad[i];
+    }
+  }
+}
+
+#else
+
+/* a.grad = alpha * a.grad */
+static inline void grad_scale(var_t &a, AD_REAL alpha) {
+  grad_scale_lanes(a.grad, alpha);
+}
+
+/* a.grad = alpha * a.grad + beta * b.grad */
+static inline void grad_axpby(var_t &a, AD_REAL alpha, const var_t &b, AD_REAL beta) {
+  grad_axpby_lanes(a.grad, alpha, b.grad, beta);
+}
+
+#endif
+
+#ifdef GRADEXPR
+
+/*
+ * expression templates: the operations build expression nodes rather than
+ * variables. A node computes its value and the partial derivatives with
+ * respect to its operands when it is built, and the gradient lanes of a whole
+ * expression are computed by a single loop when it is assigned to a variable,
+ * without intermediate gradients.
+ */
+
+/* lane `i` of the gradient of `e` into `a`, lane by lane so `a` may be an operand */
+template<class E>
+static inline void expr_eval(var_t &a, const E &e) {
+  for (size_t i = 0; i < GRADLEN; i++)
+    a.grad[i] = e.grad(i);
+  a.value = e.value;
+}
+
+/* a variable */
+struct expr_var {
+  const var_t *a;
+  AD_REAL value;
+
+  AD_REAL grad(size_t i) const { return a->grad[i]; }
+};
+
+/* alpha * e */
+template<class E>
+struct expr_scale {
+  E e;
+  AD_REAL alpha;
+  AD_REAL value;
+
+  AD_REAL grad(size_t i) const { return alpha * e.grad(i); }
+  operator var_t() const { var_t a; expr_eval(a, *this); return a; }
+};
+
+/* alpha * l + beta * r */
+template<class L, class R>
+struct expr_axpby {
+  L l;
+  AD_REAL alpha;
+  R r;
+  AD_REAL beta;
+  AD_REAL value;
+
+  AD_REAL grad(size_t i) const { return alpha * l.grad(i) + beta * r.grad(i); }
+  operator var_t() const { var_t a; expr_eval(a, *this); return a; }
+};
+
+template<>
+struct expr_of<var_t> {
+  typedef expr_var type;
+  static type node(const var_t &a) { return {&a, a.value}; }
+};
+
+template<class E>
+struct expr_of<expr_scale<E>> {
+  typedef expr_scale<E> type;
+  static const type &node(const type &e) { return e; }
+};
+
+template<class L, class R>
+struct expr_of<expr_axpby<L, R>> {
+  typedef expr_axpby<L, R> type;
+  static const type &node(const type &e) { return e; }
+};
+
+/* only defined for variables and expressions, the operators below are not viable for other types */
+template<class A>
+using expr_t = typename expr_of<A>::type;
+
+template<class A>
+static inline expr_scale<expr_t<A>> expr_scaled(const A &a, AD_REAL alpha, AD_REAL value) {
+  return {expr_of<A>::node(a), alpha, value};
+}
+
+template<class A, class B>
+static inline expr_axpby<expr_t<A>, expr_t<B>> expr_combined(const A &a, AD_REAL alpha,
+                                                             const B &b, AD_REAL beta,
+                                                             AD_REAL value) {
+  return {expr_of<A>::node(a), alpha, expr_of<B>::node(b), beta, value};
+}
+
+/* variable operations */
+template<class A>
+static expr_scale<expr_t<A>> operator-(const A &a) {
+  return expr_scaled(a, -1, -a.value);
+}
+
+/* variable variable operations */
+template<class A, class B>
+static expr_axpby<expr_t<A>, expr_t<B>> operator+(const A &a, const B &b) {
+  return expr_combined(a, 1, b, 1, a.value + b.value);
+}
+
+template<class A, class B>
+static expr_axpby<expr_t<A>, expr_t<B>> operator-(const A &a, const B &b) {
+  return expr_combined(a, 1, b, -1, a.value - b.value);
+}
+
+template<class A, class B>
+static expr_axpby<expr_t<A>, expr_t<B>> operator*(const A &a, const B &b) {
+  return expr_combined(a, b.value, b, a.value, a.value * b.value);
+}
+
+template<class A, class B>
+static expr_axpby<expr_t<A>, expr_t<B>> operator/(const A &a, const B &b) {
+  assert(b.value != 0);
+  return expr_combined(a, 1 / b.value, b, -a.value / (b.value * b.value), a.value / b.value);
+}
+
+template<class B>
+static void operator+=(var_t &a, const B &b) {
+  a = a + b;
+}
+
+template<class B>
+static void operator-=(var_t &a, const B &b) {
+  a = a - b;
+}
+
+template<class B>
+static void operator*=(var_t &a, const B &b) {
+  a = a * b;
+}
+
+template<class B>
+static void operator/=(var_t &a, const B &b) {
+  a = a / b;
+}
+
+/* variable float operations */
+template<class A>
+static expr_scale<expr_t<A>> operator+(const A &a, AD_REAL b) {
+  return expr_scaled(a, 1, a.value + b);
+}
+
+template<class A>
+static expr_scale<expr_t<A>> operator-(const A &a, AD_REAL b) {
+  return expr_scaled(a, 1, a.value - b);
+}
+
+template<class A>
+static expr_scale<expr_t<A>> operator*(const A &a, AD_REAL b) {
+  return expr_scaled(a, b, a.value * b);
+}
+
+template<class B>
+static expr_scale<expr_t<B>> operator/(AD_REAL a, const B &b) {
+  return expr_scaled(b, -a / (b.value * b.value), a / b.value);
+}
+
+static void operator/=(AD_REAL a, var_t &b) {
+  b = a / b;
+}
+
+/* variable functions */
+template<class A>
+static expr_scale<expr_t<A>> var_pow(const A &a, AD_REAL b) {
+  assert(a.value > 0);
+  AD_REAL powa = pow(a.value, b-1);
+  return expr_scaled(a, b * powa, pow(a.value, b));
+}
+
+template<class A>
+static expr_scale<expr_t<A>> var_exp(const A &a) {
+  AD_REAL expa = exp(a.value);
+  return expr_scaled(a, expa, expa);
+}
+
+template<class A>
+static expr_scale<expr_t<A>> var_cos(const A &a) {
+  return expr_scaled(a, -sin(a.value), cos(a.value));
+}
+
+template<class A>
+static expr_scale<expr_t<A>> var_sin(const A &a) {
+  return expr_scaled(a, cos(a.value), sin(a.value));
+}
+
+template<class A>
+static expr_scale<expr_t<A>> var_sqrt(const A &a) {
+  /* assert(a.value > 0); */
+  return expr_scaled(a, (AD_REAL) 0.5 / sqrt(a.value), sqrt(a.value));
+}
+
+#else
+
 /* variable operations */
 static var_t operator-(var_t a) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = -a.grad[i];
+  grad_scale(a, -1);
   a.value = -a.value;
   return a;
 }
 
 /* variable variable operations */
 static var_t operator+(var_t a, const var_t &b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = a.grad[i] + b.grad[i];
+  grad_axpby(a, 1, b, 1);
   a.value = a.value + b.value;
   return a;
 }
 
 static var_t operator-(var_t a, const var_t &b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = a.grad[i] - b.grad[i];
+  grad_axpby(a, 1, b, -1);
   a.value = a.value - b.value;
   return a;
 }
 
 static var_t operator*(var_t a, const var_t &b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = b.value * a.grad[i] + a.value * b.grad[i];
+  grad_axpby(a, b.value, b, a.value);
   a.value = a.value * b.value;
   return a;
 }
 
 static var_t operator/(var_t a, const var_t &b) {
   assert(b.value != 0);
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = (b.value * a.grad[i] - a.value * b.grad[i]) / (b.value * b.value);
+  grad_axpby(a, 1 / b.value, b, -a.value / (b.value * b.value));
   a.value = a.value / b.value;
   return a;
 }
 
 static void operator+=(var_t &a, const var_t &b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = a.grad[i] + b.grad[i];
+  grad_axpby(a, 1, b, 1);
   a.value = a.value + b.value;
 }
 
 static void operator-=(var_t &a, const var_t &b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = a.grad[i] - b.grad[i];
+  grad_axpby(a, 1, b, -1);
   a.value = a.value - b.value;
 }
 
 static void operator*=(var_t &a, const var_t &b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = b.value * a.grad[i] + a.value * b.grad[i];
+  grad_axpby(a, b.value, b, a.value);
   a.value = a.value * b.value;
 }
 
 static void operator/=(var_t &a, const var_t &b) {
   assert(b.value != 0);
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = (b.value * a.grad[i] - a.value * b.grad[i]) / (b.value * b.value);
+  grad_axpby(a, 1 / b.value, b, -a.value / (b.value * b.value));
   a.value = a.value / b.value;
 }
 
 /* variable float operations */
-static var_t operator+(var_t a, float b) {
+static var_t operator+(var_t a, AD_REAL b) {
   a.value += b;
   return a;
 }
 
-static var_t operator-(var_t a, float b) {
+static var_t operator-(var_t a, AD_REAL b) {
   a.value -= b;
   return a;
 }
 
-static var_t operator*(var_t a, float b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] *= b;
+static var_t operator*(var_t a, AD_REAL b) {
+  grad_scale(a, b);
   a.value *= b;
   return a;
 }
 
-static var_t operator/(float a, var_t b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    b.grad[i] = -a * b.grad[i] / (b.value * b.value);
+static var_t operator/(AD_REAL a, var_t b) {
+  grad_scale(b, -a / (b.value * b.value));
   b.value = a / b.value;
   return b;
 }
 
-static void operator+=(var_t &a, float b) {
+static void operator+=(var_t &a, AD_REAL b) {
   a.value += b;
 }
 
-static void operator-=(var_t &a, float b) {
+static void operator-=(var_t &a, AD_REAL b) {
   a.value -= b;
 }
 
-static void operator*=(var_t &a, float b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] *= b;
+static void operator*=(var_t &a, AD_REAL b) {
+  grad_scale(a, b);
   a.value *= b;
 }
 
-static void operator/=(float a, var_t &b) {
-  for (size_t i = 0; i < GRADLEN; i++)
-    b.grad[i] = -a * b.grad[i] / (b.value * b.value);
+static void operator/=(AD_REAL a, var_t &b) {
+  grad_scale(b, -a / (b.value * b.value));
   b.value = a / b.value;
 }
 
 /* variable functions */
-static var_t var_pow(var_t a, float b) {
+static var_t var_pow(var_t a, AD_REAL b) {
   assert(a.value > 0);
-  float pow = powf(a.value, b-1);
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = b * a.grad[i] * pow;
-  a.value = powf(a.value, b);
+  AD_REAL powa = pow(a.value, b-1);
+  grad_scale(a, b * powa);
+  a.value = pow(a.value, b);
   return a;
 }
 
 static var_t var_exp(var_t a) {
-  float expa = expf(a.value);
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = a.grad[i] * expa;
+  AD_REAL expa = exp(a.value);
+  grad_scale(a, expa);
   a.value = expa;
   return a;
 }
 
 static var_t var_cos(var_t a) {
-  float sina = -sinf(a.value);
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = a.grad[i] * sina;
-  a.value = cosf(a.value);
+  AD_REAL sina = -sin(a.value);
+  grad_scale(a, sina);
+  a.value = cos(a.value);
   return a;
 }
 
 static var_t var_sin(var_t a) {
-  float cosa = cosf(a.value);
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = a.grad[i] * cosa;
-  a.value = sinf(a.value);
+  AD_REAL cosa = cos(a.value);
+  grad_scale(a, cosa);
+  a.value = sin(a.value);
   return a;
 }
 
 static var_t var_sqrt(var_t a) {
   /* assert(a.value > 0); */
-  for (size_t i = 0; i < GRADLEN; i++)
-    a.grad[i] = 0.5 * a.grad[i] / sqrtf(a.value);
-  a.value = sqrtf(a.value);
+  grad_scale(a, (AD_REAL) 0.5 / sqrt(a.value));
+  a.value = sqrt(a.value);
   return a;
 }
 
 #endif
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * ============================================================================
+ * Vectorized Forward Mode Autodiff With A Runtime Gradient Length
+ * ============================================================================
+ * This header-only implementation provides the same forward mode automatic
+ * differentiation as `forward.h` on a `dvar_t` type whose gradient length is
+ * chosen at runtime instead of by the `GRADLEN` macro.
+ *
+ * Each `dvar_t` variable holds:
+ *  - `value`: the scalar value of the variable.
+ *  - `grad`: a pointer to a gradient vector of the length of the loaded
+ *    `dgrad_pool_t`.
+ *
+ * Gradient vectors are taken from and given back to a pool of fixed length
+ * rows, so that the temporaries created by the operators reuse the same few
+ * (hot in cache) rows instead of going through malloc. Rows are aligned and
+ * padded to a multiple of `DGRAD_BLOCK` lanes, and the common lengths 8, 16, 32
+ * and 64 have kernels specialized for their length.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute ∂f/∂x and ∂f/∂y for f(x, y) = sin(x) + y²:
+ *   dgrad_pool_t *pool = dgrad_pool_create(2);
+ *   dgrad_pool_load(pool);
+ *   {
+ *     dvar_t x(1.0); dvar_seed(&x, 0); // ∂x/∂x = 1
+ *     dvar_t y(2.0); dvar_seed(&y, 1); // ∂y/∂y = 1
+ *     dvar_t f = var_sin(x) + var_pow(y, 2);
+ *     // f.value holds the result, f.grad[0] is ∂f/∂x, f.grad[1] is ∂f/∂y
+ *   }
+ *   dgrad_pool_destroy(pool);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - Always call `dgrad_pool_load()` before creating variables. The loaded
+ *    pool is per thread.
+ *  - Every `dvar_t` must be destroyed before its pool.
+ */
+
+#ifndef H_FORWARD_DYNAMIC
+#define H_FORWARD_DYNAMIC
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+/* rows are padded to a multiple of this number of lanes */
+#define DGRAD_BLOCK 16
+
+/* number of rows allocated at once when the pool runs out of free rows */
+#define DGRAD_POOL_CHUNK 64
+
+typedef struct dgrad_row {
+  struct dgrad_row *next;
+} dgrad_row_t;
+
+typedef struct dgrad_chunk {
+  struct dgrad_chunk *next;
+} dgrad_chunk_t;
+
+typedef struct {
+  size_t width;  /* gradient length */
+  size_t padded_width;  /* gradient length rounded up to `DGRAD_BLOCK` */
+  dgrad_row_t *free_rows;
+  dgrad_chunk_t *chunks;
+} dgrad_pool_t;
+
+/* should not be set directly, use `dgrad_pool_load` instead */
+static thread_local dgrad_pool_t *global_dgrad_pool = NULL;
+
+static dgrad_pool_t *dgrad_pool_create(size_t width) {
+  assert(width > 0);
+  dgrad_pool_t *pool = (dgrad_pool_t *) malloc(sizeof(dgrad_pool_t));
+  if (pool == NULL) {
+    perror("dgrad_pool malloc");
+    exit(1);
+    return NULL;
+  }
+  *pool = {
+    .width = width,
+    .padded_width = (width + DGRAD_BLOCK-1) / DGRAD_BLOCK * DGRAD_BLOCK,
+    .free_rows = NULL,
+    .chunks = NULL,
+  };
+  return pool;
+}
+
+static void dgrad_pool_destroy(dgrad_pool_t *pool) {
+  for (dgrad_chunk_t *chunk = pool->chunks; chunk != NULL;) {
+    dgrad_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(pool);
+}
+
+/* bind `pool` to the calling thread */
+static void dgrad_pool_load(dgrad_pool_t *pool) {
+  global_dgrad_pool = pool;
+}
+
+static dgrad_pool_t *dgrad_pool_loaded() {
+  return global_dgrad_pool;
+}
+
+/* take an uninitialized row from the loaded pool */
+static float *dgrad_alloc() {
+  dgrad_pool_t *pool = global_dgrad_pool;
+  assert(pool != NULL);
+  if (pool->free_rows == NULL) {
+    /* the chunk header takes the first row to keep the rows aligned */
+    size_t row_size = pool->padded_width * sizeof(float);
+    void *memory = NULL;
+    if (posix_memalign(&memory, DGRAD_BLOCK * sizeof(float), (DGRAD_POOL_CHUNK+1) * row_size)) {
+      perror("dgrad_pool malloc");
+      exit(1);
+      return NULL;
+    }
+    dgrad_chunk_t *chunk = (dgrad_chunk_t *) memory;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    for (size_t i = DGRAD_POOL_CHUNK; i > 0; --i) {
+      dgrad_row_t *row = (dgrad_row_t *) ((char *) memory + i * row_size);
+      row->next = pool->free_rows;
+      pool->free_rows = row;
+    }
+  }
+  dgrad_row_t *row = pool->free_rows;
+  pool->free_rows = row->next;
+  return (float *) row;
+}
+
+/* give `grad` back to the loaded pool */
+static void dgrad_free(float *grad) {
+  dgrad_pool_t *pool = global_dgrad_pool;
+  dgrad_row_t *row = (dgrad_row_t *) grad;
+  row->next = pool->free_rows;
+  pool->free_rows = row;
+}
+
+/*
+ * gradient kernels, the lengths 8, 16, 32 and 64 use a loop of fixed length,
+ * the others loop over blocks of `DGRAD_BLOCK` lanes (rows are padded so there
+ * is no tail)
+ */
+template <size_t W>
+static inline void dgrad_scale_fixed(float *__restrict a, float alpha) {
+  for (size_t i = 0; i < W; i++)
+    a[i] = alpha * a[i];
+}
+
+/* `a` and `b` are the same row for `x *= x`, they are not `__restrict` */
+template <size_t W>
+static inline void dgrad_axpby_fixed(float *a, float alpha, const float *b, float beta) {
+  for (size_t i = 0; i < W; i++)
+    a[i] = alpha * a[i] + beta * b[i];
+}
+
+/* a = alpha * a */
+static inline void dgrad_scale(float *a, float alpha) {
+  size_t width = global_dgrad_pool->padded_width;
+  switch (global_dgrad_pool->width) {
+    case 8:  dgrad_scale_fixed<8>(a, alpha);  return;
+    case 16: dgrad_scale_fixed<16>(a, alpha); return;
+    case 32: dgrad_scale_fixed<32>(a, alpha); return;
+    case 64: dgrad_scale_fixed<64>(a, alpha); return;
+  }
+  for (size_t i = 0; i < width; i += DGRAD_BLOCK)
+    dgrad_scale_fixed<DGRAD_BLOCK>(a + i, alpha);
+}
+
+/* a = alpha * a + beta * b */
+static inline void dgrad_axpby(float *a, float alpha, const float *b, float beta) {
+  size_t width = global_dgrad_pool->padded_width;
+  switch (global_dgrad_pool->width) {
+    case 8:  dgrad_axpby_fixed<8>(a, alpha, b, beta);  return;
+    case 16: dgrad_axpby_fixed<16>(a, alpha, b, beta); return;
+    case 32: dgrad_axpby_fixed<32>(a, alpha, b, beta); return;
+    case 64: dgrad_axpby_fixed<64>(a, alpha, b, beta); return;
+  }
+  for (size_t i = 0; i < width; i += DGRAD_BLOCK)
+    dgrad_axpby_fixed<DGRAD_BLOCK>(a + i, alpha, b + i, beta);
+}
+
+/*
+ * a variable that does not derive from the inputs is created with `dvar_t(x)`,
+ * its gradient is zero
+ */
+struct dvar_t {
+  float value;
+  float *grad;
+
+  dvar_t(float value = 0) : value(value), grad(dgrad_alloc()) {
+    memset(grad, 0, global_dgrad_pool->padded_width * sizeof(float));
+  }
+
+  dvar_t(const dvar_t &a) : value(a.value), grad(dgrad_alloc()) {
+    memcpy(grad, a.grad, global_dgrad_pool->padded_width * sizeof(float));
+  }
+
+  dvar_t(dvar_t &&a) : value(a.value), grad(a.grad) {
+    a.grad = NULL;
+  }
+
+  dvar_t &operator=(const dvar_t &a) {
+    if (grad == NULL)  /* moved from */
+      grad = dgrad_alloc();
+    value = a.value;
+    memcpy(grad, a.grad, global_dgrad_pool->padded_width * sizeof(float));
+    return *this;
+  }
+
+  dvar_t &operator=(dvar_t &&a) {
+    float *grad_tmp = grad;
+    value = a.value;
+    grad = a.grad;
+    a.grad = grad_tmp;
+    return *this;
+  }
+
+  ~dvar_t() {
+    if (grad != NULL)
+      dgrad_free(grad);
+  }
+};
+
+/* set ∂a/∂x = 1 where x is the input associated with gradient lane `lane` */
+static void dvar_seed(dvar_t *a, size_t lane) {
+  assert(lane < global_dgrad_pool->width);
+  a->grad[lane] = 1;
+}
+
+/* variable operations */
+static dvar_t operator-(dvar_t a) {
+  dgrad_scale(a.grad, -1);
+  a.value = -a.value;
+  return a;
+}
+
+/* variable variable operations */
+static dvar_t operator+(dvar_t a, const dvar_t &b) {
+  dgrad_axpby(a.grad, 1, b.grad, 1);
+  a.value = a.value + b.value;
+  return a;
+}
+
+static dvar_t operator-(dvar_t a, const dvar_t &b) {
+  dgrad_axpby(a.grad, 1, b.grad, -1);
+  a.value = a.value - b.value;
+  return a;
+}
+
+static dvar_t operator*(dvar_t a, const dvar_t &b) {
+  dgrad_axpby(a.grad, b.value, b.grad, a.value);
+  a.value = a.value * b.value;
+  return a;
+}
+
+static dvar_t operator/(dvar_t a, const dvar_t &b) {
+  assert(b.value != 0);
+  dgrad_axpby(a.grad, 1 / b.value, b.grad, -a.value / (b.value * b.value));
+  a.value = a.value / b.value;
+  return a;
+}
+
+static void operator+=(dvar_t &a, const dvar_t &b) {
+  dgrad_axpby(a.grad, 1, b.grad, 1);
+  a.value = a.value + b.value;
+}
+
+static void operator-=(dvar_t &a, const dvar_t &b) {
+  dgrad_axpby(a.grad, 1, b.grad, -1);
+  a.value = a.value - b.value;
+}
+
+static void operator*=(dvar_t &a, const dvar_t &b) {
+  dgrad_axpby(a.grad, b.value, b.grad, a.value);
+  a.value = a.value * b.value;
+}
+
+static void operator/=(dvar_t &a, const dvar_t &b) {
+  assert(b.value != 0);
+  dgrad_axpby(a.grad, 1 / b.value, b.grad, -a.value / (b.value * b.value));
+  a.value = a.value / b.value;
+}
+
+/* variable float operations */
+static dvar_t operator+(dvar_t a, float b) {
+  a.value += b;
+  return a;
+}
+
+static dvar_t operator-(dvar_t a, float b) {
+  a.value -= b;
+  return a;
+}
+
+static dvar_t operator*(dvar_t a, float b) {
+  dgrad_scale(a.grad, b);
+  a.value *= b;
+  return a;
+}
+
+static dvar_t operator/(float a, dvar_t b) {
+  dgrad_scale(b.grad, -a / (b.value * b.value));
+  b.value = a / b.value;
+  return b;
+}
+
+static void operator+=(dvar_t &a, float b) {
+  a.value += b;
+}
+
+static void operator-=(dvar_t &a, float b) {
+  a.value -= b;
+}
+
+static void operator*=(dvar_t &a, float b) {
+  dgrad_scale(a.grad, b);
+  a.value *= b;
+}
+
+/* variable functions */
+static dvar_t var_pow(dvar_t a, float b) {
+  assert(a.value > 0);
+  float pow = powf(a.value, b-1);
+  dgrad_scale(a.grad, b * pow);
+  a.value = powf(a.value, b);
+  return a;
+}
+
+static dvar_t var_exp(dvar_t a) {
+  float expa = expf(a.value);
+  dgrad_scale(a.grad, expa);
+  a.value = expa;
+  return a;
+}
+
+static dvar_t var_cos(dvar_t a) {
+  float sina = -sinf(a.value);
+  dgrad_scale(a.grad, sina);
+  a.value = cosf(a.value);
+  return a;
+}
+
+static dvar_t var_sin(dvar_t a) {
+  float cosa = cosf(a.value);
+  dgrad_scale(a.grad, cosa);
+  a.value = sinf(a.value);
+  return a;
+}
+
+static dvar_t var_sqrt(dvar_t a) {
+  /* assert(a.value > 0); */
+  dgrad_scale(a.grad, 0.5f / sqrtf(a.value));
+  a.value = sqrtf(a.value);
+  return a;
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * ============================================================================
+ * Parallel Chunked Forward Mode Autodiff
+ * ============================================================================
+ * This header computes the gradient of a function of `n_inputs` inputs with
+ * `forward.h` when `n_inputs` is larger than `GRADLEN`. The inputs are split
+ * into chunks of `GRADLEN` inputs, the function is evaluated once per chunk
+ * with the gradient lanes seeded for the inputs of that chunk, and the chunks
+ * are spread across the workers of a persistent `pool_t`.
+ *
+ * A `forward_parallel_t` keeps the input variables of the workers from one
+ * call to the next, so that a call allocates nothing once the buffer holds
+ * the largest number of inputs.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute the gradient of f(x) = Σ xᵢ² for 1000 inputs:
+ *   var_t f(const var_t *inputs, void *ctx) {
+ *     var_t sum = {0};
+ *     for (size_t i = 0; i < 1000; ++i)
+ *       sum += inputs[i] * inputs[i];
+ *     return sum;
+ *   }
+ *   pool_t *pool = pool_create(4);
+ *   forward_parallel_t *fp = forward_parallel_create(pool);
+ *   float value = forward_parallel_gradient(fp, &f, NULL, x, 1000, grad);
+ *   forward_parallel_destroy(fp);
+ *   pool_destroy(pool);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - The macro `GRADLEN` must be defined before including this header.
+ *  - Link with `-pthread`.
+ *  - `fn` is called concurrently from several threads, it must not write to
+ *    shared state.
+ *  - `forward_parallel_gradient` must not be called concurrently with the same
+ *    `forward_parallel_t`.
+ */
+
+#ifndef H_FORWARD_PARALLEL
+#define H_FORWARD_PARALLEL
+
+#include "forward.h"
+#include "pool.h"
+
+/* evaluate the function on the `n_inputs` input variables */
+typedef var_t (*forward_fn_t)(const var_t *inputs, void *ctx);
+
+typedef struct {
+  pool_t *pool;
+  var_t *worker_inputs;  /* `capacity` variables per worker of `pool` */
+  size_t capacity;
+} forward_parallel_t;
+
+static forward_parallel_t *forward_parallel_create(pool_t *pool) {
+  forward_parallel_t *fp = (forward_parallel_t *) malloc(sizeof(forward_parallel_t));
+  if (fp == NULL) {
+    perror("forward_parallel malloc");
+    exit(1);
+    return NULL;
+  }
+  *fp = {
+    .pool = pool,
+    .worker_inputs = NULL,
+    .capacity = 0,
+  };
+  return fp;
+}
+
+static void forward_parallel_destroy(forward_parallel_t *fp) {
+  free(fp->worker_inputs);
+  free(fp);
+}
+
+/* make room for `n_inputs` variables per worker */
+static void forward_parallel_reserve(forward_parallel_t *fp, size_t n_inputs) {
+  if (n_inputs <= fp->capacity)
+    return;
+  free(fp->worker_inputs);
+  /* `var_t` is over-aligned when `GRADSIMD` is defined */
+  void *worker_inputs = NULL;
+  size_t alignment = alignof(var_t) > sizeof(void *) ? alignof(var_t) : sizeof(void *);
+  if (posix_memalign(&worker_inputs, alignment, pool_workers(fp->pool) * n_inputs * sizeof(var_t))) {
+    perror("forward_parallel malloc");
+    exit(1);
+    return;
+  }
+  fp->worker_inputs = (var_t *) worker_inputs;
+  fp->capacity = n_inputs;
+}
+
+typedef struct {
+  forward_fn_t fn;
+  void *ctx;
+  const AD_REAL *inputs;
+  size_t n_inputs;
+  var_t *worker_inputs;  /* `stride` variables per worker, the first `n_inputs` are used */
+  size_t stride;
+  AD_REAL *grad;
+  AD_REAL value;
+} fp_param_t;
+
+static void fp_chunk(size_t chunk_id, size_t worker_id, void *param_ptr) {
+  fp_param_t *param = (fp_param_t *) param_ptr;
+  var_t *inputs = param->worker_inputs + worker_id * param->stride;
+  size_t grad_start = chunk_id * GRADLEN;
+
+  for (size_t i = 0; i < param->n_inputs; ++i) {
+    var_zero(&inputs[i]);
+    inputs[i].value = param->inputs[i];
+    if (i >= grad_start && i < grad_start + GRADLEN) {
+      var_seed(&inputs[i], i - grad_start);
+    }
+  }
+
+  var_t out = param->fn(inputs, param->ctx);
+
+  if (chunk_id == 0) {
+    param->value = out.value;
+  }
+  for (size_t i = 0; i < GRADLEN && grad_start + i < param->n_inputs; ++i) {
+    param->grad[grad_start + i] = out.grad[i];
+  }
+}
+
+/*
+ * store in `grad` the gradient of `fn` at `inputs` and return the value of
+ * `fn`, the ceil(n_inputs / GRADLEN) chunks are evaluated by the workers of
+ * the pool of `fp`
+ */
+static AD_REAL forward_parallel_gradient(forward_parallel_t *fp, forward_fn_t fn, void *ctx,
+                                       const AD_REAL *inputs, size_t n_inputs,
+                                       AD_REAL *grad) {
+  assert(n_inputs > 0);
+  size_t chunks = (n_inputs + GRADLEN-1) / GRADLEN;
+  forward_parallel_reserve(fp, n_inputs);
+
+  fp_param_t param = {
+    .fn = fn,
+    .ctx = ctx,
+    .inputs = inputs,
+    .n_inputs = n_inputs,
+    .worker_inputs = fp->worker_inputs,
+    .stride = fp->capacity,
+    .grad = grad,
+    .value = 0,
+  };
+  pool_run(fp->pool, &fp_chunk, &param, chunks);
+
+  return param.value;
+}
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ * ============================================================================
+ * Persistent Worker Pool
+ * ============================================================================
+ * This header-only implementation provides a pool of worker threads that are
+ * created once and reused for every parallel evaluation, which avoids paying
+ * for `pthread_create` and `pthread_join` at each iteration of an optimization
+ * loop.
+ *
+ * `pool_run` hands `n_tasks` tasks to the workers and returns once all of them
+ * are done. The calling thread takes part in the work as worker 0, the other
+ * workers sleep on a condition variable between two calls to `pool_run`.
+ *
+ * Tasks are first split evenly into one deque per worker. A worker pops tasks
+ * from the bottom of its own deque and, once it is empty, steals tasks from
+ * the top of the other deques, so that a worker that is delayed (uneven tasks,
+ * cores shared with other processes) does not hold the whole run back. Define
+ * `POOL_STATIC` to disable stealing and keep the even split.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ *   void task(size_t task_id, size_t worker_id, void *ctx) { ... }
+ *   pool_t *pool = pool_create(4);
+ *   for (size_t i = 0; i < ITERATIONS; ++i)
+ *     pool_run(pool, &task, ctx, n_tasks);
+ *   pool_destroy(pool);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - Link with `-pthread`.
+ *  - `pool_run` must not be called concurrently on the same pool.
+ */
+
+#ifndef H_POOL
+#define H_POOL
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+/* size of a cache line, used to keep the deques of two workers apart */
+#define POOL_CACHE_LINE 64
+
+/* run task `task_id`, `worker_id` is in [0, workers) */
+typedef void (*pool_task_t)(size_t task_id, size_t worker_id, void *ctx);
+
+typedef struct pool pool_t;
+
+/*
+ * the tasks of a deque are the range [top, bottom), both bounds are packed in
+ * a single word so that the owner and the thieves update them with one CAS
+ */
+typedef struct {
+  alignas(POOL_CACHE_LINE) uint64_t range;
+} pool_deque_t;
+
+static inline uint64_t pool_range(uint32_t top, uint32_t bottom) {
+  return ((uint64_t) top << 32) | bottom;
+}
+
+typedef struct {
+  pool_t *pool;
+  size_t worker_id;
+} pool_worker_param_t;
+
+struct pool {
+  size_t workers;
+  pthread_t *threads;
+  pool_worker_param_t *params;
+  pool_deque_t *deques;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t start_cond;
+  pthread_cond_t done_cond;
+  uint64_t generation;  /* incremented at each `pool_run` */
+  size_t running;  /* number of workers that have not finished the current run */
+  int stop;
+
+  /* the current run */
+  pool_task_t fn;
+  void *ctx;
+  size_t n_tasks;
+};
+
+/* pop a task from the bottom of `deque`, returns false if it is empty */
+static bool pool_pop(pool_deque_t *deque, size_t *task_id) {
+  uint64_t range = __atomic_load_n(&deque->range, __ATOMIC_RELAXED);
+  for (;;) {
+    uint32_t top = range >> 32, bottom = (uint32_t) range;
+    if (top >= bottom)
+      return false;
+    if (__atomic_compare_exchange_n(&deque->range, &range, pool_range(top, bottom-1),
+                                    true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      *task_id = bottom-1;
+      return true;
+    }
+  }
+}
+
+/* steal a task from the top of `deque`, returns false if it is empty */
+static bool pool_steal(pool_deque_t *deque, size_t *task_id) {
+  uint64_t range = __atomic_load_n(&deque->range, __ATOMIC_RELAXED);
+  for (;;) {
+    uint32_t top = range >> 32, bottom = (uint32_t) range;
+    if (top >= bottom)
+      return false;
+    if (__atomic_compare_exchange_n(&deque->range, &range, pool_range(top+1, bottom),
+                                    true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      *task_id = top;
+      return true;
+    }
+  }
+}
+
+/* run the tasks of worker `worker_id` for the current run */
+static void pool_work(pool_t *pool, size_t worker_id) {
+#ifdef POOL_STATIC
+  size_t start_task = pool->n_tasks * worker_id / pool->workers;
+  size_t end_task = pool->n_tasks * (worker_id+1) / pool->workers;
+  for (size_t task_id = start_task; task_id < end_task; ++task_id)
+    pool->fn(task_id, worker_id, pool->ctx);
+#else
+  size_t task_id;
+  while (pool_pop(&pool->deques[worker_id], &task_id))
+    pool->fn(task_id, worker_id, pool->ctx);
+
+  /* no task is added during a run, a full round of failed steals means done */
+  for (size_t victim = 1; victim < pool->workers;) {
+    pool_deque_t *deque = &pool->deques[(worker_id + victim) % pool->workers];
+    if (pool_steal(deque, &task_id)) {
+      pool->fn(task_id, worker_id, pool->ctx);
+    } else {
+      ++victim;
+    }
+  }
+#endif
+}
+
+static void *pool_worker(void *param_ptr) {
+  pool_worker_param_t *param = (pool_worker_param_t *) param_ptr;
+  pool_t *pool = param->pool;
+  uint64_t generation = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stop && pool->generation == generation)
+      pthread_cond_wait(&pool->start_cond, &pool->mutex);
+    if (pool->stop) {
+      pthread_mutex_unlock(&pool->mutex);
+      return NULL;
+    }
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_work(pool, param->worker_id);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->running == 0)
+      pthread_cond_signal(&pool->done_cond);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+static pool_t *pool_create(size_t workers) {
+  assert(workers > 0);
+  pool_t *pool = (pool_t *) malloc(sizeof(pool_t));
+  pthread_t *threads = (pthread_t *) malloc(workers * sizeof(pthread_t));
+  pool_worker_param_t *params = (pool_worker_param_t *) malloc(workers * sizeof(pool_worker_param_t));
+  void *deques = NULL;
+  int err = posix_memalign(&deques, POOL_CACHE_LINE, workers * sizeof(pool_deque_t));
+  if (pool == NULL || threads == NULL || params == NULL || err) {
+    perror("pool malloc");
+    exit(1);
+    return NULL;
+  }
+  pool->workers = workers;
+  pool->threads = threads;
+  pool->params = params;
+  pool->deques = (pool_deque_t *) deques;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->start_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  pool->generation = 0;
+  pool->running = 0;
+  pool->stop = 0;
+
+  /* worker 0 is the thread calling `pool_run` */
+  for (size_t worker_id = 1; worker_id < workers; ++worker_id) {
+    params[worker_id] = {
+      .pool = pool,
+      .worker_id = worker_id,
+    };
+    err = pthread_create(&threads[worker_id], NULL, &pool_worker, &params[worker_id]);
+    if (err) {
+      printf("pthread_create error %d", err);
+      exit(1);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+static void pool_destroy(pool_t *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->start_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (size_t worker_id = 1; worker_id < pool->workers; ++worker_id) {
+    int err = pthread_join(pool->threads[worker_id], NULL);
+    if (err) {
+      printf("pthread_join error %d", err);
+      exit(1);
+      return;
+    }
+  }
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->start_cond);
+  pthread_cond_destroy(&pool->done_cond);
+  free(pool->threads);
+  free(pool->params);
+  free(pool->deques);
+  free(pool);
+}
+
+static size_t pool_workers(pool_t *pool) {
+  return pool->workers;
+}
+
+/* run `fn` on every task in [0, n_tasks) and wait for all of them */
+static void pool_run(pool_t *pool, pool_task_t fn, void *ctx, size_t n_tasks) {
+  assert(n_tasks <= UINT32_MAX);
+  for (size_t worker_id = 0; worker_id < pool->workers; ++worker_id) {
+    uint32_t top = n_tasks * worker_id / pool->workers;
+    uint32_t bottom = n_tasks * (worker_id+1) / pool->workers;
+    __atomic_store_n(&pool->deques[worker_id].range, pool_range(top, bottom), __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->fn = fn;
+  pool->ctx = ctx;
+  pool->n_tasks = n_tasks;
+  pool->running = pool->workers - 1;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->start_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  pool_work(pool, 0);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->running > 0)
+    pthread_cond_wait(&pool->done_cond, &pool->mutex);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+#endif
@@ -6,7 +6,7 @@
  * differentiation using a dynamic computation tape and operator overloading
  * on a custom `var_t` type.
  *
- * Each `var_t` variable corresponds to a node on a global tape. The tape
+ * Each `var_t` variable corresponds to a node on the loaded tape. The tape
  * records the computation graph by tracking the operation and parent variables
  * for each intermediate result.
  *
@@ -21,13 +21,38 @@
  *   tape_load(tape);
  *   var_t x = var_create(1.0f);
  *   var_t y = var_create(2.0f);
- *   var_t f = var_sin(x) + var_pow(y, var_create(2.0f));
+ *   var_t f = var_sin(x) + var_pow(y, 2.0f);
  *   tape_reverse_pass(tape, f);
  *   // var_adjoint(x) returns ∂f/∂x, var_adjoint(y) returns ∂f/∂y
  *
  * Notes:
  * ----------------------------------------------------------------------------
- *  - Always call `tape_load()` before creating variables.
+ *  - Always call `tape_load()` before creating variables. The loaded tape is
+ *    per thread, a tape must not be shared between threads.
+ *  - Constants should be given as plain floats (`x * 2`, `var_pow(x, 3)`):
+ *    they are then stored in the entry of the operation instead of taking an
+ *    entry of their own like a `var_create`d variable would.
+ *  - Define `AD_REAL` (default `float`) to change the type of the values and
+ *    of the adjoints, e.g. `double`.
+ *  - Define `TAPE_SOA` to store the tape as a structure of arrays.
+ *  - Define `TAPE_MMAP` to reserve the address space of the whole tape up
+ *    front so that growing it never copies entries (POSIX only).
+ *  - Define `TAPE_SPILL` (with `TAPE_SOA`, POSIX only) to keep the operators
+ *    and the parents of the entries in a temporary file under
+ *    `TAPE_SPILL_DIR` rather than in memory.
+ *  - Define `TAPE_MAX_LENGTH` to change the maximum number of entries.
+ *  - Define `ADJLEN` to enable `tape_reverse_pass_vec`, which computes the
+ *    adjoints of up to `ADJLEN` outputs in a single reverse pass.
+ *  - A statement can be preaccumulated: `var_preaccumulate` replaces the
+ *    entries recorded since `tape_mark()` by a single entry holding the
+ *    gradient of the statement with respect to its inputs, e.g.
+ *      tape_mark_t mark = tape_mark();
+ *      var_t y = var_preaccumulate(mark, var_exp(a * b) / (a + b));
+ *    which makes the tape shorter and the reverse pass faster when the
+ *    statement has many operations and few inputs.
+ *  - Sums and dot products of many variables should be recorded with
+ *    `var_sum` and `var_dot`, which take a single entry where chained `+`
+ *    would take one entry per term and a chain of dependent adjoint updates.
  */
 
 #ifndef H_AUTODIFF
@@ -40,8 +65,29 @@
 #include <assert.h>
 #include <math.h>
 #include <string.h>
+#if defined(TAPE_MMAP) || defined(TAPE_SPILL)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef TAPE_SPILL
+#include <fcntl.h>
+#endif
+
+#if defined(TAPE_SPILL) && !defined(TAPE_SOA)
+#error "TAPE_SPILL requires TAPE_SOA"
+#endif
+
+/* at most 2^32 - 1, the entries are indexed by `uint32_t` */
+#ifndef TAPE_MAX_LENGTH
+#define TAPE_MAX_LENGTH (1 << 25)  /* correspond to a ~670mb tape */
+#endif
+
+const uint32_t MAX_TAPE_LENGTH = TAPE_MAX_LENGTH;
 
-const uint32_t MAX_TAPE_LENGTH = 1 << 25;  /* correspond to a ~670mb tape */
+/* type of the values and of the adjoints */
+#ifndef AD_REAL
+#define AD_REAL float
+#endif
 
 typedef enum {
   NIL = 0,
@@ -55,13 +101,109 @@ typedef enum {
   COS,
   SIN,
   SQRT,
+  /* operators between a variable `a` and a constant `c` stored in the entry */
+  ADD_CONST,  /* a + c */
+  CONST_SUB,  /* c - a */
+  MUL_CONST,  /* a * c */
+  DIV_CONST,  /* a / c */
+  CONST_DIV,  /* c / a */
+  POW_CONST,  /* a ^ c */
+  CONST_POW,  /* c ^ a */
+  /*
+   * operators with any number of parents, stored in the side arrays of the
+   * tape with their partials, see `tape_multi_start` and `tape_multi_count`
+   */
+  MULTI,  /* partials computed when recorded, see `var_preaccumulate` */
+  SUM,  /* Σ c_k a_k, the partials are the constants c_k */
+  DOT,  /* Σ a_k b_k, the parents are a_0, b_0, a_1, b_1... */
 } operator_t;
 
+/* number of operators, must follow the last value of `operator_t` */
+#define OPERATOR_COUNT (DOT+1)
+
+/* number of parents of the entries with operator `op` */
+static inline int operator_parents(operator_t op) {
+  switch (op) {
+    case NIL:
+    case MULTI:  /* variable, see `tape_multi_count` */
+    case SUM:
+    case DOT:
+      return 0;
+    case ADD:
+    case SUB:
+    case MUL:
+    case DIV:
+    case POW:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+/* whether the entries with operator `op` store a constant */
+static inline bool operator_constant(operator_t op) {
+  return op >= ADD_CONST && op <= CONST_POW;
+}
+
+/* whether the parents of the entries with operator `op` are in the side arrays */
+static inline bool operator_multi(operator_t op) {
+  return op >= MULTI;
+}
+
+/*
+ * the second operand of an entry, the right parent or, for the operators with
+ * a constant, the constant itself, so that constants do not take tape entries
+ */
+typedef union {
+  uint32_t parent;
+  AD_REAL constant;
+} tape_operand_t;
+
+#ifdef ADJLEN
+/* the adjoints of one tape entry with respect to `ADJLEN` seeded outputs */
 typedef struct {
-  float value;
-  float adjoint;
+  AD_REAL adjoint[ADJLEN];
+} adjvec_t;
+#endif
+
+/*
+ * By default the tape is an array of `tape_entry_t` records (AoS). Defining
+ * `TAPE_SOA` before including this header stores each field in its own
+ * contiguous array instead, so that `tape_clear` and `tape_reverse_pass` only
+ * touch the fields they need. Use the `tape_*` accessors below rather than the
+ * fields of `tape_t` to stay independent of the layout.
+ */
+#ifdef TAPE_SOA
+
+typedef struct {
+  uint32_t length;
+  uint32_t capacity;
+  AD_REAL *values;
+  AD_REAL *adjoints;
+  uint32_t *left_parents;
+  tape_operand_t *right_operands;
+  uint8_t *ops;
+  uint32_t *multi_parents;  /* parents of the `MULTI`, `SUM` and `DOT` entries */
+  AD_REAL *multi_partials;  /* partial derivatives with respect to them */
+  uint32_t multi_length;
+  uint32_t multi_capacity;
+  bool mapped;  /* the arrays point into a file loaded by `tape_file_load` */
+#ifdef ADJLEN
+  adjvec_t *adjvecs;
+  uint32_t adjvecs_capacity;
+#endif
+#ifdef TAPE_SPILL
+  int spill_fd;  /* file backing `left_parents`, `right_operands` and `ops` */
+#endif
+} tape_t;
+
+#else
+
+typedef struct {
+  AD_REAL value;
+  AD_REAL adjoint;
+  tape_operand_t right_operand;  /* before `left_parent` to avoid padding */
   uint32_t left_parent;
-  uint32_t right_parent;
   operator_t op;
 } tape_entry_t;
 
@@ -69,62 +211,526 @@ typedef struct {
   uint32_t length;
   uint32_t capacity;
   tape_entry_t *entries;
+  uint32_t *multi_parents;  /* parents of the `MULTI`, `SUM` and `DOT` entries */
+  AD_REAL *multi_partials;  /* partial derivatives with respect to them */
+  uint32_t multi_length;
+  uint32_t multi_capacity;
+  bool mapped;  /* the arrays point into a file loaded by `tape_file_load` */
+#ifdef ADJLEN
+  adjvec_t *adjvecs;
+  uint32_t adjvecs_capacity;
+#endif
 } tape_t;
 
+#endif
+
 typedef struct {
   uint32_t index;
 } var_t;
 
-/* should not be set directly, use `tape_load` instead */
-static tape_t *global_tape = NULL;
+/*
+ * should not be set directly, use `tape_load` instead. Each thread has its own
+ * binding so that several threads can record independent graphs.
+ */
+static thread_local tape_t *global_tape = NULL;
+
+/* tape entry accessors */
+#ifdef TAPE_SOA
+
+static inline AD_REAL &tape_value(tape_t *tape, uint32_t i) {
+  return tape->values[i];
+}
+
+static inline AD_REAL &tape_adjoint(tape_t *tape, uint32_t i) {
+  return tape->adjoints[i];
+}
+
+static inline uint32_t tape_left(tape_t *tape, uint32_t i) {
+  return tape->left_parents[i];
+}
+
+static inline uint32_t tape_right(tape_t *tape, uint32_t i) {
+  return tape->right_operands[i].parent;
+}
+
+static inline AD_REAL tape_constant(tape_t *tape, uint32_t i) {
+  return tape->right_operands[i].constant;
+}
+
+static inline operator_t tape_op(tape_t *tape, uint32_t i) {
+  return (operator_t) tape->ops[i];
+}
+
+static inline void tape_set(tape_t *tape, uint32_t i, operator_t op,
+                            AD_REAL value, uint32_t left, uint32_t right) {
+  tape->values[i] = value;
+  tape->left_parents[i] = left;
+  tape->right_operands[i].parent = right;
+  tape->ops[i] = (uint8_t) op;
+}
+
+static inline void tape_set_constant(tape_t *tape, uint32_t i, operator_t op,
+                                     AD_REAL value, uint32_t left, AD_REAL constant) {
+  tape->values[i] = value;
+  tape->left_parents[i] = left;
+  tape->right_operands[i].constant = constant;
+  tape->ops[i] = (uint8_t) op;
+}
+
+#else
+
+static inline AD_REAL &tape_value(tape_t *tape, uint32_t i) {
+  return tape->entries[i].value;
+}
+
+static inline AD_REAL &tape_adjoint(tape_t *tape, uint32_t i) {
+  return tape->entries[i].adjoint;
+}
+
+static inline uint32_t tape_left(tape_t *tape, uint32_t i) {
+  return tape->entries[i].left_parent;
+}
+
+static inline uint32_t tape_right(tape_t *tape, uint32_t i) {
+  return tape->entries[i].right_operand.parent;
+}
+
+static inline AD_REAL tape_constant(tape_t *tape, uint32_t i) {
+  return tape->entries[i].right_operand.constant;
+}
+
+static inline operator_t tape_op(tape_t *tape, uint32_t i) {
+  return tape->entries[i].op;
+}
+
+static inline void tape_set(tape_t *tape, uint32_t i, operator_t op,
+                            AD_REAL value, uint32_t left, uint32_t right) {
+  tape_entry_t *entry = &tape->entries[i];
+  entry->value = value;
+  entry->left_parent = left;
+  entry->right_operand.parent = right;
+  entry->op = op;
+}
+
+static inline void tape_set_constant(tape_t *tape, uint32_t i, operator_t op,
+                                     AD_REAL value, uint32_t left, AD_REAL constant) {
+  tape_entry_t *entry = &tape->entries[i];
+  entry->value = value;
+  entry->left_parent = left;
+  entry->right_operand.constant = constant;
+  entry->op = op;
+}
+
+#endif
+
+/*
+ * the operands of the `MULTI`, `SUM` or `DOT` entry `i` are the elements `tape_multi_start` to
+ * `tape_multi_start + tape_multi_count - 1` of `multi_parents` and
+ * `multi_partials`, the bounds are stored in the parents fields of the entry
+ */
+static inline uint32_t tape_multi_start(tape_t *tape, uint32_t i) {
+  return tape_left(tape, i);
+}
+
+static inline uint32_t tape_multi_count(tape_t *tape, uint32_t i) {
+  return tape_right(tape, i);
+}
+
+/*
+ * the arrays of the tape are allocated with the three functions below. By
+ * default they are grown with `realloc`. When `TAPE_MMAP` is defined, the
+ * address space for `MAX_TAPE_LENGTH` elements is reserved up front and
+ * growing only makes more of it accessible, so existing entries are never
+ * copied and the physical memory follows the pages actually written to.
+ */
+#if defined(TAPE_MMAP) || defined(TAPE_SPILL)
+
+/* round `size` up to a multiple of the page size */
+static size_t tape_page_round(size_t size) {
+  size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+  return (size + page_size-1) / page_size * page_size;
+}
+
+#endif
+
+#ifdef TAPE_MMAP
+
+/* above this capacity the tape grows by this number of entries at a time */
+#ifndef TAPE_MMAP_STEP
+#define TAPE_MMAP_STEP (1 << 16)
+#endif
+
+/* make the first `capacity` elements of `array` accessible */
+static void tape_array_commit(void *array, size_t elem_size, size_t capacity) {
+  size_t size = tape_page_round(capacity * elem_size);
+  if (size > 0 && mprotect(array, size, PROT_READ | PROT_WRITE)) {
+    perror("tape mprotect");
+    exit(1);
+  }
+}
+
+static void *tape_array_create(size_t elem_size, size_t capacity) {
+  size_t reserved = tape_page_round((size_t) MAX_TAPE_LENGTH * elem_size);
+  void *array = mmap(NULL, reserved, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (array == MAP_FAILED) {
+    perror("tape mmap");
+    exit(1);
+    return NULL;
+  }
+  tape_array_commit(array, elem_size, capacity);
+  return array;
+}
+
+/*
+ * anonymous pages are zero the first time they are touched, the old capacity
+ * is not needed
+ */
+static void *tape_array_grow(void *array, size_t elem_size,
+                             size_t /* old_capacity */, size_t new_capacity) {
+  tape_array_commit(array, elem_size, new_capacity);
+  return array;
+}
+
+static void tape_array_destroy(void *array, size_t elem_size) {
+  munmap(array, tape_page_round((size_t) MAX_TAPE_LENGTH * elem_size));
+}
+
+static size_t tape_next_capacity(size_t capacity) {
+  size_t next = capacity < TAPE_MMAP_STEP ? 2 * capacity : capacity + TAPE_MMAP_STEP;
+  return next < MAX_TAPE_LENGTH ? next : MAX_TAPE_LENGTH;
+}
+
+#else
+
+static void *tape_array_create(size_t elem_size, size_t capacity) {
+  void *array = calloc(capacity, elem_size);
+  if (array == NULL) {
+    perror("tape malloc");
+    exit(1);
+    return NULL;
+  }
+  return array;
+}
+
+/*
+ * grow `array` from `old_capacity` to `new_capacity` elements and zero the new
+ * elements
+ */
+static void *tape_array_grow(void *array, size_t elem_size,
+                             size_t old_capacity, size_t new_capacity) {
+  array = realloc(array, new_capacity * elem_size);
+  if (array == NULL) {
+    perror("tape realloc");
+    exit(1);
+    return NULL;
+  }
+  memset((char *) array + old_capacity * elem_size, 0,
+         (new_capacity - old_capacity) * elem_size);
+  return array;
+}
+
+static void tape_array_destroy(void *array, size_t /* elem_size */) {
+  free(array);
+}
+
+static size_t tape_next_capacity(size_t capacity) {
+  size_t next = 2 * capacity;
+  return next < MAX_TAPE_LENGTH ? next : MAX_TAPE_LENGTH;
+}
+
+#endif
+
+/*
+ * When `TAPE_SPILL` is defined, the arrays only read sequentially by the
+ * reverse pass (`ops`, `left_parents` and `right_operands`) are mapped from an
+ * unlinked temporary file instead of being allocated. The tape is split in
+ * segments of `TAPE_SPILL_SEGMENT` entries: once a segment is recorded, its
+ * write back to the file starts, and the segment before it is written and
+ * dropped from memory. The reverse pass reads the segments back in reverse
+ * order and asks the kernel to prefetch the next one. The values and the
+ * adjoints are accessed at random by the reverse pass and stay in memory.
+ */
+#ifdef TAPE_SPILL
+
+/* directory of the spill files, should not be a tmpfs */
+#ifndef TAPE_SPILL_DIR
+#define TAPE_SPILL_DIR "/var/tmp"
+#endif
+
+/* number of entries of a segment, a power of two */
+#ifndef TAPE_SPILL_SEGMENT
+#define TAPE_SPILL_SEGMENT (1 << 20)
+#endif
+
+/* size of the region of the spill file holding an array of `elem_size` elements */
+static size_t tape_spill_size(size_t elem_size) {
+  return tape_page_round((size_t) MAX_TAPE_LENGTH * elem_size);
+}
+
+/* the regions of the spill file, in this order */
+static const size_t TAPE_SPILL_ELEM_SIZES[3] = {
+  sizeof(uint8_t), sizeof(uint32_t), sizeof(tape_operand_t),
+};
+
+static size_t tape_spill_offset(int region) {
+  size_t offset = 0;
+  for (int r = 0; r < region; ++r)
+    offset += tape_spill_size(TAPE_SPILL_ELEM_SIZES[r]);
+  return offset;
+}
+
+/* create the spill file, it is deleted as soon as it is closed */
+static int tape_spill_open() {
+  char path[] = TAPE_SPILL_DIR "/tape_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("tape mkstemp");
+    exit(1);
+    return -1;
+  }
+  unlink(path);
+  /* the file is sparse, disk space is only used by the recorded entries */
+  if (ftruncate(fd, (off_t) tape_spill_offset(3))) {
+    perror("tape ftruncate");
+    exit(1);
+    return -1;
+  }
+  return fd;
+}
+
+static void *tape_spill_map(int fd, int region) {
+  void *array = mmap(NULL, tape_spill_size(TAPE_SPILL_ELEM_SIZES[region]),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                     (off_t) tape_spill_offset(region));
+  if (array == MAP_FAILED) {
+    perror("tape mmap");
+    exit(1);
+    return NULL;
+  }
+  return array;
+}
+
+static void *tape_spill_array(tape_t *tape, int region) {
+  switch (region) {
+    case 0:
+      return tape->ops;
+    case 1:
+      return tape->left_parents;
+    default:
+      return tape->right_operands;
+  }
+}
+
+/*
+ * apply to the entries [start, end) of the spilled arrays: `flags` of msync
+ * if not 0, then `advice` of madvise and, for MADV_DONTNEED, drop the pages
+ * from the page cache
+ */
+static void tape_spill_segment(tape_t *tape, size_t start, size_t end,
+                               int flags, int advice) {
+  size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+  for (int region = 0; region < 3; ++region) {
+    size_t elem_size = TAPE_SPILL_ELEM_SIZES[region];
+    size_t first = start * elem_size / page_size * page_size;
+    size_t size = end * elem_size - first;
+    char *pages = (char *) tape_spill_array(tape, region) + first;
+    if (flags != 0)
+      msync(pages, size, flags);
+    madvise(pages, size, advice);
+    if (advice == MADV_DONTNEED)
+      posix_fadvise(tape->spill_fd, (off_t) (tape_spill_offset(region) + first),
+                    (off_t) size, POSIX_FADV_DONTNEED);
+  }
+}
+
+/* called when the first `length` entries are recorded */
+static inline void tape_spill_record(tape_t *tape, size_t length) {
+  if (length % TAPE_SPILL_SEGMENT != 0)
+    return;
+  tape_spill_segment(tape, length - TAPE_SPILL_SEGMENT, length, MS_ASYNC, MADV_NORMAL);
+  if (length >= 2 * TAPE_SPILL_SEGMENT)
+    tape_spill_segment(tape, length - 2 * TAPE_SPILL_SEGMENT,
+                       length - TAPE_SPILL_SEGMENT, MS_SYNC, MADV_DONTNEED);
+}
+
+/*
+ * called by the reverse passes before processing entry `i`, when entering a
+ * segment prefetch the one before it and drop the one just processed
+ */
+static inline void tape_spill_reverse(tape_t *tape, size_t i) {
+  size_t end = i+1;
+  if (end % TAPE_SPILL_SEGMENT != 0)
+    return;
+  if (end >= 2 * TAPE_SPILL_SEGMENT)
+    tape_spill_segment(tape, end - 2 * TAPE_SPILL_SEGMENT,
+                       end - TAPE_SPILL_SEGMENT, 0, MADV_WILLNEED);
+  if (end + TAPE_SPILL_SEGMENT <= tape->length)
+    tape_spill_segment(tape, end, end + TAPE_SPILL_SEGMENT, 0, MADV_DONTNEED);
+}
+
+#endif
 
 /*
  * setting the initial capacity of the tape to a number like 64 will prevent too
  * much calls to realloc
  */
 static tape_t *tape_create(size_t capacity) {
-  assert(capacity <= (size_t) MAX_TAPE_LENGTH);
+  assert(capacity > 0 && capacity <= (size_t) MAX_TAPE_LENGTH);
   tape_t *tape = (tape_t *) malloc(sizeof(tape_t));
-  tape_entry_t *entries = (tape_entry_t *) calloc(capacity, sizeof(tape_entry_t));
-  if (tape == NULL || entries == NULL) {
+  if (tape == NULL) {
     perror("tape malloc");
     exit(1);
     return NULL;
   }
+#if defined(TAPE_SPILL)
+  int fd = tape_spill_open();
+  *tape = {
+    .length = 0,
+    .capacity = (uint32_t) capacity,
+    .values = (AD_REAL *) tape_array_create(sizeof(AD_REAL), capacity),
+    .adjoints = (AD_REAL *) tape_array_create(sizeof(AD_REAL), capacity),
+    .left_parents = (uint32_t *) tape_spill_map(fd, 1),
+    .right_operands = (tape_operand_t *) tape_spill_map(fd, 2),
+    .ops = (uint8_t *) tape_spill_map(fd, 0),
+    .multi_parents = NULL,
+    .multi_partials = NULL,
+    .multi_length = 0,
+    .multi_capacity = 0,
+    .mapped = false,
+#ifdef ADJLEN
+    .adjvecs = NULL,
+    .adjvecs_capacity = 0,
+#endif
+    .spill_fd = fd,
+  };
+#elif defined(TAPE_SOA)
+  *tape = {
+    .length = 0,
+    .capacity = (uint32_t) capacity,
+    .values = (AD_REAL *) tape_array_create(sizeof(AD_REAL), capacity),
+    .adjoints = (AD_REAL *) tape_array_create(sizeof(AD_REAL), capacity),
+    .left_parents = (uint32_t *) tape_array_create(sizeof(uint32_t), capacity),
+    .right_operands = (tape_operand_t *) tape_array_create(sizeof(tape_operand_t), capacity),
+    .ops = (uint8_t *) tape_array_create(sizeof(uint8_t), capacity),
+    .multi_parents = NULL,
+    .multi_partials = NULL,
+    .multi_length = 0,
+    .multi_capacity = 0,
+    .mapped = false,
+#ifdef ADJLEN
+    .adjvecs = NULL,
+    .adjvecs_capacity = 0,
+#endif
+  };
+#else
   *tape = {
     .length = 0,
     .capacity = (uint32_t) capacity,
-    .entries = entries,
+    .entries = (tape_entry_t *) tape_array_create(sizeof(tape_entry_t), capacity),
+    .multi_parents = NULL,
+    .multi_partials = NULL,
+    .multi_length = 0,
+    .multi_capacity = 0,
+    .mapped = false,
+#ifdef ADJLEN
+    .adjvecs = NULL,
+    .adjvecs_capacity = 0,
+#endif
   };
+#endif
   return tape;
 }
 
 static void tape_destroy(tape_t *tape) {
-  free(tape->entries);
+  assert(!tape->mapped && "close loaded tapes with tape_file_close");
+  free(tape->multi_parents);
+  free(tape->multi_partials);
+#ifdef ADJLEN
+  free(tape->adjvecs);
+#endif
+#if defined(TAPE_SPILL)
+  tape_array_destroy(tape->values, sizeof(AD_REAL));
+  tape_array_destroy(tape->adjoints, sizeof(AD_REAL));
+  for (int region = 0; region < 3; ++region)
+    munmap(tape_spill_array(tape, region), tape_spill_size(TAPE_SPILL_ELEM_SIZES[region]));
+  close(tape->spill_fd);
+#elif defined(TAPE_SOA)
+  tape_array_destroy(tape->values, sizeof(AD_REAL));
+  tape_array_destroy(tape->adjoints, sizeof(AD_REAL));
+  tape_array_destroy(tape->left_parents, sizeof(uint32_t));
+  tape_array_destroy(tape->right_operands, sizeof(tape_operand_t));
+  tape_array_destroy(tape->ops, sizeof(uint8_t));
+#else
+  tape_array_destroy(tape->entries, sizeof(tape_entry_t));
+#endif
   free(tape);
 }
 
 static void tape_extend(tape_t *tape) {
+  assert(!tape->mapped && "nothing can be recorded on a loaded tape");
   assert(tape->length < MAX_TAPE_LENGTH);
   if (tape->length == tape->capacity) {
-    size_t entries_size = tape->capacity * sizeof(*tape->entries);
-    tape->entries = (tape_entry_t *) realloc(tape->entries, 2 * entries_size);
-    if (tape->entries == NULL) {
-      perror("tape realloc");
-      exit(1);
-      return;
-    }
-    memset(tape->entries + tape->capacity, 0, entries_size);
-    tape->capacity = 2 * tape->capacity;
+    size_t old_capacity = tape->capacity;
+    size_t new_capacity = tape_next_capacity(old_capacity);
+#if defined(TAPE_SPILL)
+    /* the spilled arrays are mapped for `MAX_TAPE_LENGTH` entries */
+    tape->values = (AD_REAL *) tape_array_grow(tape->values, sizeof(AD_REAL), old_capacity, new_capacity);
+    tape->adjoints = (AD_REAL *) tape_array_grow(tape->adjoints, sizeof(AD_REAL), old_capacity, new_capacity);
+#elif defined(TAPE_SOA)
+    tape->values = (AD_REAL *) tape_array_grow(tape->values, sizeof(AD_REAL), old_capacity, new_capacity);
+    tape->adjoints = (AD_REAL *) tape_array_grow(tape->adjoints, sizeof(AD_REAL), old_capacity, new_capacity);
+    tape->left_parents = (uint32_t *) tape_array_grow(tape->left_parents, sizeof(uint32_t), old_capacity, new_capacity);
+    tape->right_operands = (tape_operand_t *) tape_array_grow(tape->right_operands, sizeof(tape_operand_t), old_capacity, new_capacity);
+    tape->ops = (uint8_t *) tape_array_grow(tape->ops, sizeof(uint8_t), old_capacity, new_capacity);
+#else
+    tape->entries = (tape_entry_t *) tape_array_grow(tape->entries, sizeof(tape_entry_t), old_capacity, new_capacity);
+#endif
+    tape->capacity = (uint32_t) new_capacity;
   }
   ++tape->length;
+#ifdef TAPE_SPILL
+  /* the entry being recorded is written after, it belongs to the next segment */
+  tape_spill_record(tape, tape->length - 1);
+#endif
 }
 
+/* make room for `n` more operands in the side arrays */
+static void tape_multi_reserve(tape_t *tape, size_t n) {
+  assert(!tape->mapped && "nothing can be recorded on a loaded tape");
+  size_t length = (size_t) tape->multi_length + n;
+  if (length <= tape->multi_capacity)
+    return;
+  assert(length <= UINT32_MAX);
+  size_t capacity = tape->multi_capacity > 0 ? tape->multi_capacity : 64;
+  while (capacity < length)
+    capacity *= 2;
+  if (capacity > UINT32_MAX)
+    capacity = UINT32_MAX;
+  tape->multi_parents = (uint32_t *) realloc(tape->multi_parents, capacity * sizeof(uint32_t));
+  tape->multi_partials = (AD_REAL *) realloc(tape->multi_partials, capacity * sizeof(AD_REAL));
+  if (tape->multi_parents == NULL || tape->multi_partials == NULL) {
+    perror("tape realloc");
+    exit(1);
+    return;
+  }
+  tape->multi_capacity = (uint32_t) capacity;
+}
+
+/*
+ * entries are fully rewritten by `tape_set` when recorded and adjoints are
+ * reset by `tape_reverse_pass`, so in SoA mode there is nothing to zero. The
+ * memory of the tape is kept and reused by the next recording.
+ */
 static void tape_clear(tape_t *tape) {
+#ifndef TAPE_SOA
   memset(tape->entries, 0, tape->length * sizeof(*tape->entries));
+#endif
   tape->length = 0;
+  tape->multi_length = 0;
 }
 
+/* bind `tape` to the calling thread */
 static void tape_load(tape_t *tape) {
   global_tape = tape;
 }
@@ -133,129 +739,318 @@ static tape_t *tape_loaded() {
   return global_tape;
 }
 
+/*
+ * store in `left_partial` and `right_partial` the partial derivatives of entry
+ * `i` with respect to its parents, returns the number of parents of `i`
+ */
+static inline int tape_partials(tape_t *tape, uint32_t i,
+                                 AD_REAL *left_partial, AD_REAL *right_partial) {
+  uint32_t left = tape_left(tape, i);
+  uint32_t right = tape_right(tape, i);
+  AD_REAL value = tape_value(tape, i);
+  *left_partial = 0;
+  *right_partial = 0;
+  switch (tape_op(tape, i)) {
+    case NIL:
+      return 0;
+    case NEG:
+      *left_partial = -1;
+      break;
+    case ADD:
+      *left_partial  = 1;
+      *right_partial = 1;
+      break;
+    case SUB:
+      *left_partial  = 1;
+      *right_partial = -1;
+      break;
+    case MUL:
+      *left_partial  = tape_value(tape, right);
+      *right_partial = tape_value(tape, left);
+      break;
+    case DIV:
+      *left_partial  = 1 / tape_value(tape, right);
+      *right_partial = -1 * (value / tape_value(tape, right));
+      break;
+    case POW:
+      *left_partial  = tape_value(tape, right) * (value / tape_value(tape, left));
+      *right_partial = value * log(tape_value(tape, left));
+      break;
+    case EXP:
+      *left_partial = value;
+      break;
+    case COS:
+      *left_partial = -1 * sqrt(1 - value*value);
+      break;
+    case SIN:
+      *left_partial = sqrt(1 - value*value);
+      break;
+    case SQRT:
+      *left_partial = 1 / (2 * value);
+      break;
+    case ADD_CONST:
+      *left_partial = 1;
+      break;
+    case CONST_SUB:
+      *left_partial = -1;
+      break;
+    case MUL_CONST:
+      *left_partial = tape_constant(tape, i);
+      break;
+    case DIV_CONST:
+      *left_partial = 1 / tape_constant(tape, i);
+      break;
+    case CONST_DIV:
+      *left_partial = -1 * (value / tape_value(tape, left));
+      break;
+    case POW_CONST:
+      *left_partial = tape_constant(tape, i) * (value / tape_value(tape, left));
+      break;
+    case CONST_POW:
+      *left_partial = value * log(tape_constant(tape, i));
+      break;
+    case MULTI:
+    case SUM:
+    case DOT:
+      assert(false && "the partials of these entries are in the side arrays");
+      return 0;
+  }
+  return operator_parents(tape_op(tape, i));
+}
+
 static void tape_reverse_pass(tape_t *tape, var_t start) {
+#ifdef TAPE_SOA
+  memset(tape->adjoints, 0, tape->length * sizeof(*tape->adjoints));
+#else
   for (size_t i = 0; i < tape->length; ++i)
     tape->entries[i].adjoint = 0;
-  tape->entries[start.index].adjoint = 1;
+#endif
+  tape_adjoint(tape, start.index) = 1;
 
   for (size_t i = start.index+1; i-- > 0;) {  /* avoid size_t wraps */
-    tape_entry_t *entry = &tape->entries[i];
-    tape_entry_t *left_parent_entry = &tape->entries[entry->left_parent];
-    tape_entry_t *right_parent_entry = &tape->entries[entry->right_parent];
-    switch (entry->op) {
-      case NIL:
-        break;
-      case NEG:
-        left_parent_entry->adjoint += entry->adjoint * -1;
-        break;
-      case ADD:
-        left_parent_entry->adjoint  += entry->adjoint * 1;
-        right_parent_entry->adjoint += entry->adjoint * 1;
-        break;
-      case SUB:
-        left_parent_entry->adjoint  += entry->adjoint * 1;
-        right_parent_entry->adjoint += entry->adjoint * -1;
-        break;
-      case MUL:
-        left_parent_entry->adjoint  += entry->adjoint * right_parent_entry->value;
-        right_parent_entry->adjoint += entry->adjoint * left_parent_entry->value;
-        break;
-      case DIV:
-        left_parent_entry->adjoint  += entry->adjoint / right_parent_entry->value;
-        right_parent_entry->adjoint += entry->adjoint * -1 * (entry->value / right_parent_entry->value);
-        break;
-      case POW:
-        left_parent_entry->adjoint  += entry->adjoint * right_parent_entry->value * (entry->value / left_parent_entry->value);
-        right_parent_entry->adjoint += entry->adjoint * entry->value * logf(left_parent_entry->value);
-        break;
-      case EXP:
-        left_parent_entry->adjoint += entry->adjoint * entry->value;
-        break;
-      case COS:
-        left_parent_entry->adjoint += entry->adjoint * -1 * sqrtf(1 - entry->value*entry->value);
-        break;
-      case SIN:
-        left_parent_entry->adjoint += entry->adjoint * sqrtf(1 - entry->value*entry->value);
-        break;
-      case SQRT:
-        left_parent_entry->adjoint += entry->adjoint / (2 * entry->value);
-        break;
+#ifdef TAPE_SPILL
+    tape_spill_reverse(tape, i);
+#endif
+    if (operator_multi(tape_op(tape, i))) {
+      AD_REAL adjoint = tape_adjoint(tape, i);
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      for (uint32_t k = start; k < end; ++k)
+        tape_adjoint(tape, tape->multi_parents[k]) += adjoint * tape->multi_partials[k];
+      continue;
     }
+    AD_REAL left_partial, right_partial;
+    int parents = tape_partials(tape, i, &left_partial, &right_partial);
+    if (parents == 0)
+      continue;
+    AD_REAL adjoint = tape_adjoint(tape, i);
+    tape_adjoint(tape, tape_left(tape, i)) += adjoint * left_partial;
+    if (parents == 2)
+      tape_adjoint(tape, tape_right(tape, i)) += adjoint * right_partial;
   }
 }
 
+#ifdef ADJLEN
+/*
+ * vector mode reverse pass: seed the adjoint lane `k` of `starts[k]` for each
+ * of the `n_starts <= ADJLEN` outputs and propagate all the lanes in a single
+ * sweep, the adjoints are then read with `var_adjoint_vec`
+ */
+static void tape_reverse_pass_vec(tape_t *tape, const var_t *starts, size_t n_starts) {
+  assert(n_starts > 0 && n_starts <= ADJLEN);
+  if (tape->adjvecs_capacity < tape->capacity) {
+    free(tape->adjvecs);
+    tape->adjvecs = (adjvec_t *) malloc(tape->capacity * sizeof(adjvec_t));
+    if (tape->adjvecs == NULL) {
+      perror("tape malloc");
+      exit(1);
+      return;
+    }
+    tape->adjvecs_capacity = tape->capacity;
+  }
+
+  uint32_t last = 0;
+  memset(tape->adjvecs, 0, tape->length * sizeof(adjvec_t));
+  for (size_t k = 0; k < n_starts; ++k) {
+    tape->adjvecs[starts[k].index].adjoint[k] = 1;
+    if (starts[k].index > last)
+      last = starts[k].index;
+  }
+
+  for (size_t i = last+1; i-- > 0;) {  /* avoid size_t wraps */
+#ifdef TAPE_SPILL
+    tape_spill_reverse(tape, i);
+#endif
+    const AD_REAL *adjoint = tape->adjvecs[i].adjoint;
+    if (operator_multi(tape_op(tape, i))) {
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      for (uint32_t m = start; m < end; ++m) {
+        AD_REAL *parent_adjoint = tape->adjvecs[tape->multi_parents[m]].adjoint;
+        for (size_t k = 0; k < ADJLEN; ++k)
+          parent_adjoint[k] += adjoint[k] * tape->multi_partials[m];
+      }
+      continue;
+    }
+    AD_REAL left_partial, right_partial;
+    int parents = tape_partials(tape, i, &left_partial, &right_partial);
+    if (parents == 0)
+      continue;
+    AD_REAL *left_adjoint = tape->adjvecs[tape_left(tape, i)].adjoint;
+    for (size_t k = 0; k < ADJLEN; ++k)
+      left_adjoint[k] += adjoint[k] * left_partial;
+    if (parents == 2) {
+      AD_REAL *right_adjoint = tape->adjvecs[tape_right(tape, i)].adjoint;
+      for (size_t k = 0; k < ADJLEN; ++k)
+        right_adjoint[k] += adjoint[k] * right_partial;
+    }
+  }
+}
+#endif
+
 /* append new variable to global_tape */
-static var_t var_create(float value) {
+static var_t var_record(operator_t op, AD_REAL value, uint32_t left, uint32_t right) {
+  assert(global_tape != NULL);
+  var_t a = {global_tape->length};
+  tape_extend(global_tape);
+  tape_set(global_tape, a.index, op, value, left, right);
+  return a;
+}
+
+/* append new variable computed from `left` and the constant `constant` */
+static var_t var_record_constant(operator_t op, AD_REAL value, uint32_t left, AD_REAL constant) {
   assert(global_tape != NULL);
   var_t a = {global_tape->length};
   tape_extend(global_tape);
-  global_tape->entries[a.index].value = value;
+  tape_set_constant(global_tape, a.index, op, value, left, constant);
   return a;
 }
 
-static float var_adjoint(var_t a) {
-  return global_tape->entries[a.index].adjoint;
+static var_t var_create(AD_REAL value) {
+  return var_record(NIL, value, 0, 0);
+}
+
+static AD_REAL var_adjoint(var_t a) {
+  return tape_adjoint(global_tape, a.index);
+}
+
+#ifdef ADJLEN
+/* adjoints of `a` with respect to each output seeded by `tape_reverse_pass_vec` */
+static const AD_REAL *var_adjoint_vec(var_t a) {
+  return global_tape->adjvecs[a.index].adjoint;
+}
+#endif
+
+static AD_REAL var_value(var_t a) {
+  return tape_value(global_tape, a.index);
+}
+
+/* position of the loaded tape at the start of a preaccumulated region */
+typedef struct {
+  uint32_t length;
+  uint32_t multi_length;
+} tape_mark_t;
+
+static tape_mark_t tape_mark() {
+  assert(global_tape != NULL);
+  return {global_tape->length, global_tape->multi_length};
+}
+
+/* add `partial` to the partial derivative with respect to `parent` at the end of the side arrays */
+static void tape_multi_accumulate(tape_t *tape, uint32_t start, uint32_t parent, AD_REAL partial) {
+  for (uint32_t k = start; k < tape->multi_length; ++k) {
+    if (tape->multi_parents[k] == parent) {
+      tape->multi_partials[k] += partial;
+      return;
+    }
+  }
+  tape_multi_reserve(tape, 1);
+  tape->multi_parents[tape->multi_length] = parent;
+  tape->multi_partials[tape->multi_length] = partial;
+  ++tape->multi_length;
 }
 
-static float var_value(var_t a) {
-  return global_tape->entries[a.index].value;
+/*
+ * replace the entries recorded since `mark` by a single entry holding the
+ * partial derivatives of `out` with respect to the variables recorded before
+ * `mark`, and return this entry. The variables recorded since `mark` other
+ * than `out` must not be used afterwards.
+ */
+static var_t var_preaccumulate(tape_mark_t mark, var_t out) {
+  tape_t *tape = global_tape;
+  assert(tape != NULL && out.index < tape->length);
+  if (out.index < mark.length || tape->length - mark.length <= 1)
+    return out;  /* nothing to merge */
+
+  /* local reverse pass from `out`, the adjoints of the region are scratch space */
+  for (uint32_t i = mark.length; i <= out.index; ++i)
+    tape_adjoint(tape, i) = 0;
+  tape_adjoint(tape, out.index) = 1;
+  uint32_t start = tape->multi_length;  /* partials with respect to the parents before `mark` */
+  for (uint32_t i = out.index+1; i-- > mark.length;) {  /* avoid uint32_t wraps */
+    AD_REAL adjoint = tape_adjoint(tape, i);
+    if (adjoint == 0)
+      continue;
+    if (operator_multi(tape_op(tape, i))) {
+      uint32_t m_start = tape_multi_start(tape, i), m_end = m_start + tape_multi_count(tape, i);
+      for (uint32_t m = m_start; m < m_end; ++m) {
+        uint32_t parent = tape->multi_parents[m];
+        if (parent >= mark.length)
+          tape_adjoint(tape, parent) += adjoint * tape->multi_partials[m];
+        else
+          tape_multi_accumulate(tape, start, parent, adjoint * tape->multi_partials[m]);
+      }
+      continue;
+    }
+    AD_REAL partials[2];
+    int n_parents = tape_partials(tape, i, &partials[0], &partials[1]);
+    uint32_t parents[2] = {tape_left(tape, i), n_parents == 2 ? tape_right(tape, i) : 0};
+    for (int p = 0; p < n_parents; ++p) {
+      if (parents[p] >= mark.length)
+        tape_adjoint(tape, parents[p]) += adjoint * partials[p];
+      else
+        tape_multi_accumulate(tape, start, parents[p], adjoint * partials[p]);
+    }
+  }
+
+  /* the operands found move where the region had its own operands */
+  AD_REAL value = tape_value(tape, out.index);
+  uint32_t count = tape->multi_length - start;
+  memmove(tape->multi_parents + mark.multi_length, tape->multi_parents + start, count * sizeof(uint32_t));
+  memmove(tape->multi_partials + mark.multi_length, tape->multi_partials + start, count * sizeof(AD_REAL));
+  tape->length = mark.length;
+  tape->multi_length = mark.multi_length;
+  if (count == 0)
+    return var_create(value);
+  /*
+   * a single parent also takes a `MULTI` entry, as a `MUL_CONST` its partial
+   * would pass for a constant of the computation and the replays, generated
+   * code and Hessian-vector products would not reject the tape
+   */
+  tape->multi_length += count;
+  return var_record(MULTI, value, mark.multi_length, count);
 }
 
 /* variable operations */
 static var_t operator-(var_t a) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  var_t b = var_create(-a_entry->value);
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  b_entry->op = NEG;
-  b_entry->left_parent = a.index;
-  return b;
+  return var_record(NEG, -var_value(a), a.index, 0);
 }
 
 
 /* variable variable operations */
 static var_t operator+(var_t a, var_t b) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  var_t c = var_create(a_entry->value + b_entry->value);
-  tape_entry_t *c_entry = &global_tape->entries[c.index];
-  c_entry->op = ADD;
-  c_entry->left_parent = a.index;
-  c_entry->right_parent = b.index;
-  return c;
+  return var_record(ADD, var_value(a) + var_value(b), a.index, b.index);
 }
 
 static var_t operator-(var_t a, var_t b) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  var_t c = var_create(a_entry->value - b_entry->value);
-  tape_entry_t *c_entry = &global_tape->entries[c.index];
-  c_entry->op = SUB;
-  c_entry->left_parent = a.index;
-  c_entry->right_parent = b.index;
-  return c;
+  return var_record(SUB, var_value(a) - var_value(b), a.index, b.index);
 }
 
 static var_t operator*(var_t a, var_t b) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  var_t c = var_create(a_entry->value * b_entry->value);
-  tape_entry_t *c_entry = &global_tape->entries[c.index];
-  c_entry->op = MUL;
-  c_entry->left_parent = a.index;
-  c_entry->right_parent = b.index;
-  return c;
+  return var_record(MUL, var_value(a) * var_value(b), a.index, b.index);
 }
 
 static var_t operator/(var_t a, var_t b) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  var_t c = var_create(a_entry->value / b_entry->value);
-  assert(b_entry->value != 0);
-  tape_entry_t *c_entry = &global_tape->entries[c.index];
-  c_entry->op = DIV;
-  c_entry->left_parent = a.index;
-  c_entry->right_parent = b.index;
-  return c;
+  assert(var_value(b) != 0);
+  return var_record(DIV, var_value(a) / var_value(b), a.index, b.index);
 }
 
 static void operator+=(var_t &a, var_t b) {
@@ -274,54 +1069,134 @@ static void operator/=(var_t &a, var_t b) {
   a = a / b;
 }
 
+/* variable float operations, the float is stored in the entry */
+static var_t operator+(var_t a, AD_REAL b) {
+  return var_record_constant(ADD_CONST, var_value(a) + b, a.index, b);
+}
+
+static var_t operator+(AD_REAL a, var_t b) {
+  return b + a;
+}
+
+static var_t operator-(var_t a, AD_REAL b) {
+  return var_record_constant(ADD_CONST, var_value(a) - b, a.index, -b);
+}
+
+static var_t operator-(AD_REAL a, var_t b) {
+  return var_record_constant(CONST_SUB, a - var_value(b), b.index, a);
+}
+
+static var_t operator*(var_t a, AD_REAL b) {
+  return var_record_constant(MUL_CONST, var_value(a) * b, a.index, b);
+}
+
+static var_t operator*(AD_REAL a, var_t b) {
+  return b * a;
+}
+
+static var_t operator/(var_t a, AD_REAL b) {
+  assert(b != 0);
+  return var_record_constant(DIV_CONST, var_value(a) / b, a.index, b);
+}
+
+static var_t operator/(AD_REAL a, var_t b) {
+  assert(var_value(b) != 0);
+  return var_record_constant(CONST_DIV, a / var_value(b), b.index, a);
+}
+
+static void operator+=(var_t &a, AD_REAL b) {
+  a = a + b;
+}
+
+static void operator-=(var_t &a, AD_REAL b) {
+  a = a - b;
+}
+
+static void operator*=(var_t &a, AD_REAL b) {
+  a = a * b;
+}
+
+static void operator/=(var_t &a, AD_REAL b) {
+  a = a / b;
+}
+
 /* variable functions */
 static var_t var_pow(var_t a, var_t b) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  assert(a_entry->value > 0);
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  var_t c = var_create(powf(a_entry->value, b_entry->value));
-  tape_entry_t *c_entry = &global_tape->entries[c.index];
-  c_entry->op = POW;
-  c_entry->left_parent = a.index;
-  c_entry->right_parent = b.index;
-  return c;
+  assert(var_value(a) > 0);
+  return var_record(POW, pow(var_value(a), var_value(b)), a.index, b.index);
+}
+
+static var_t var_pow(var_t a, AD_REAL b) {
+  assert(var_value(a) > 0);
+  return var_record_constant(POW_CONST, pow(var_value(a), b), a.index, b);
+}
+
+static var_t var_pow(AD_REAL a, var_t b) {
+  assert(a > 0);
+  return var_record_constant(CONST_POW, pow(a, var_value(b)), b.index, a);
 }
 
 static var_t var_exp(var_t a) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  var_t b = var_create(expf(a_entry->value));
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  b_entry->op = EXP;
-  b_entry->left_parent = a.index;
-  return b;
+  return var_record(EXP, exp(var_value(a)), a.index, 0);
 }
 
 static var_t var_cos(var_t a) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  var_t b = var_create(cosf(a_entry->value));
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  b_entry->op = COS;
-  b_entry->left_parent = a.index;
-  return b;
+  return var_record(COS, cos(var_value(a)), a.index, 0);
 }
 
 static var_t var_sin(var_t a) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  var_t b = var_create(sinf(a_entry->value));
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  b_entry->op = SIN;
-  b_entry->left_parent = a.index;
-  return b;
+  return var_record(SIN, sin(var_value(a)), a.index, 0);
 }
 
 static var_t var_sqrt(var_t a) {
-  tape_entry_t *a_entry = &global_tape->entries[a.index];
-  /* assert(a_entry->value > 0); */
-  var_t b = var_create(sqrtf(a_entry->value));
-  tape_entry_t *b_entry = &global_tape->entries[b.index];
-  b_entry->op = SQRT;
-  b_entry->left_parent = a.index;
-  return b;
+  /* assert(var_value(a) > 0); */
+  return var_record(SQRT, sqrt(var_value(a)), a.index, 0);
+}
+
+/* n-ary operations, a single entry however many operands */
+
+/* Σ c[k] a[k], or Σ a[k] if `c` is NULL */
+static var_t var_sum(const var_t *a, const AD_REAL *c, size_t n) {
+  tape_t *tape = global_tape;
+  assert(tape != NULL && n <= UINT32_MAX);
+  tape_multi_reserve(tape, n);
+  uint32_t start = tape->multi_length;
+  AD_REAL value = 0;
+  for (size_t k = 0; k < n; ++k) {
+    AD_REAL partial = c != NULL ? c[k] : 1;
+    tape->multi_parents[start+k] = a[k].index;
+    tape->multi_partials[start+k] = partial;
+    value += partial * var_value(a[k]);
+  }
+  tape->multi_length += n;
+  return var_record(SUM, value, start, n);
+}
+
+static var_t var_sum(const var_t *a, size_t n) {
+  return var_sum(a, NULL, n);
+}
+
+/* Σ a[k] b[k] */
+static var_t var_dot(const var_t *a, const var_t *b, size_t n) {
+  tape_t *tape = global_tape;
+  assert(tape != NULL && n <= UINT32_MAX / 2);
+  tape_multi_reserve(tape, 2*n);
+  uint32_t start = tape->multi_length;
+  AD_REAL value = 0;
+  for (size_t k = 0; k < n; ++k) {
+    AD_REAL a_value = var_value(a[k]), b_value = var_value(b[k]);
+    tape->multi_parents[start + 2*k] = a[k].index;
+    tape->multi_partials[start + 2*k] = b_value;
+    tape->multi_parents[start + 2*k+1] = b[k].index;
+    tape->multi_partials[start + 2*k+1] = a_value;
+    value += a_value * b_value;
+  }
+  tape->multi_length += 2*n;
+  return var_record(DOT, value, start, 2*n);
+}
+
+static var_t var_dot(const var_t *a, const AD_REAL *c, size_t n) {
+  return var_sum(a, c, n);
 }
 
 #endif
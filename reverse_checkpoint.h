@@ -0,0 +1,205 @@
+/*
+ * ============================================================================
+ * Binomial Checkpointing For Long Time-Stepping Computations
+ * ============================================================================
+ * This header differentiates computations made of many applications of the
+ * same step function, x[i+1] = step(x[i], i), followed by a scalar loss of
+ * the final state, without keeping the whole computation on a tape. Only one
+ * step is recorded at a time, the tape is cleared between two steps.
+ *
+ * During the reverse sweep the state before each step must be available
+ * again. Instead of storing all of them, at most `n_checkpoints` states are
+ * stored and the others are recomputed from the closest checkpoint. The
+ * checkpoints are placed with the binomial schedule of revolve (Griewank and
+ * Walther), which minimizes the number of recomputed steps for the given
+ * number of checkpoints: with c checkpoints, n steps are differentiated with
+ * each step recomputed at most t times as long as n <= (c+t)! / (c! t!).
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute the gradient of the final position of a damped oscillator with
+ * respect to its initial position and speed:
+ *   void step(var_t *state, size_t i, void *ctx) {
+ *     var_t x = state[0], v = state[1];
+ *     state[0] = x + v * 0.01f;
+ *     state[1] = v - (x + v * 0.1f) * 0.01f;
+ *   }
+ *   var_t loss(const var_t *state, void *ctx) {
+ *     return state[0];
+ *   }
+ *   float initial_state[2] = {1, 0}, grad[2];
+ *   float x = checkpoint_gradient(&step, &loss, NULL, initial_state, 2,
+ *                                 100000, 10, grad);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - The memory used is `n_checkpoints` states and the tape of a single step,
+ *    whatever the number of steps.
+ *  - `step` and `loss` record their operations on the loaded tape, they are
+ *    called several times for the same step and must only depend on their
+ *    arguments.
+ *  - The tape loaded by the caller is restored before returning.
+ */
+
+#ifndef H_REVERSE_CHECKPOINT
+#define H_REVERSE_CHECKPOINT
+
+#include "reverse.h"
+
+/* replace the `n_state` variables of `state` by their values after step `i` */
+typedef void (*checkpoint_step_t)(var_t *state, size_t i, void *ctx);
+
+/* record the loss of the final state */
+typedef var_t (*checkpoint_loss_t)(const var_t *state, void *ctx);
+
+typedef struct {
+  checkpoint_step_t step;
+  void *ctx;
+  size_t n_state;
+  tape_t *tape;
+  var_t *vars;  /* the `n_state` variables of the state being recorded */
+  AD_REAL *checkpoints;  /* `n_checkpoints` states */
+  size_t n_checkpoints;
+  AD_REAL *work;  /* state recomputed when no checkpoint is left */
+} checkpoint_t;
+
+/* (c+t)! / (c! t!), the number of steps c checkpoints and t repetitions cover */
+static size_t checkpoint_beta(size_t c, size_t t) {
+  if (c > t) {  /* symmetric in c and t, loop over the smaller one */
+    size_t swap = c;
+    c = t;
+    t = swap;
+  }
+  size_t beta = 1;
+  for (size_t k = 1; k <= c; ++k) {
+    if (beta > SIZE_MAX / (t+k))
+      return SIZE_MAX;
+    beta = beta * (t+k) / k;  /* exact, beta is C(t+k-1, k-1) here */
+  }
+  return beta;
+}
+
+/* record step `i` from the values of `state` on the cleared tape */
+static void checkpoint_record(checkpoint_t *cp, const AD_REAL *state, size_t i) {
+  tape_clear(cp->tape);
+  for (size_t k = 0; k < cp->n_state; ++k)
+    cp->vars[k] = var_create(state[k]);
+  cp->step(cp->vars, i, cp->ctx);
+}
+
+/* advance `state` in place from step `from` to step `to` */
+static void checkpoint_advance(checkpoint_t *cp, AD_REAL *state, size_t from, size_t to) {
+  for (size_t i = from; i < to; ++i) {
+    checkpoint_record(cp, state, i);
+    for (size_t k = 0; k < cp->n_state; ++k)
+      state[k] = var_value(cp->vars[k]);
+  }
+}
+
+/*
+ * replace `adjoint`, the adjoint of the state after step `i`, by the adjoint of
+ * `state`, the state before step `i`
+ */
+static void checkpoint_reverse_step(checkpoint_t *cp, const AD_REAL *state, size_t i,
+                                    AD_REAL *adjoint) {
+  /* the input variables are the first `n_state` entries of the tape */
+  checkpoint_record(cp, state, i);
+
+  /* seed the outputs with `adjoint` through their weighted sum */
+  var_t sum = cp->vars[0] * adjoint[0];
+  for (size_t k = 1; k < cp->n_state; ++k)
+    sum += cp->vars[k] * adjoint[k];
+  tape_reverse_pass(cp->tape, sum);
+  for (size_t k = 0; k < cp->n_state; ++k) {
+    var_t input = {(uint32_t) k};
+    adjoint[k] = var_adjoint(input);
+  }
+}
+
+/*
+ * replace `adjoint`, the adjoint of the state after step `end`, by the adjoint
+ * of `state`, the state before step `start`, with `free_checkpoints` left
+ */
+static void checkpoint_reverse(checkpoint_t *cp, const AD_REAL *state, size_t start,
+                               size_t end, size_t free_checkpoints, AD_REAL *adjoint) {
+  /* the steps before the checkpoint are reversed by the next iteration */
+  while (end - start > 1 && free_checkpoints > 0) {
+    /*
+     * with t the smallest number of repetitions such that beta(free_checkpoints, t) >= n,
+     * the steps after the checkpoint are reversed with one checkpoint less and
+     * the steps before it with one repetition less
+     */
+    size_t n = end - start;
+    size_t t = 1;
+    while (checkpoint_beta(free_checkpoints, t) < n)
+      ++t;
+    size_t right = checkpoint_beta(free_checkpoints-1, t);
+    size_t split = start + (n > right ? n - right : 1);
+
+    AD_REAL *checkpoint = cp->checkpoints + (cp->n_checkpoints - free_checkpoints) * cp->n_state;
+    memcpy(checkpoint, state, cp->n_state * sizeof(AD_REAL));
+    checkpoint_advance(cp, checkpoint, start, split);
+    checkpoint_reverse(cp, checkpoint, split, end, free_checkpoints-1, adjoint);
+    end = split;
+  }
+
+  /* no checkpoint left, recompute the state before each step from `state` */
+  for (size_t i = end; i-- > start;) {  /* avoid size_t wraps */
+    memcpy(cp->work, state, cp->n_state * sizeof(AD_REAL));
+    checkpoint_advance(cp, cp->work, start, i);
+    checkpoint_reverse_step(cp, cp->work, i, adjoint);
+  }
+}
+
+/*
+ * store in `grad` the gradient of `loss` after `n_steps` applications of
+ * `step` with respect to the `n_state` values of `initial_state` and return
+ * the value of `loss`, at most `n_checkpoints` intermediate states are stored
+ */
+static AD_REAL checkpoint_gradient(checkpoint_step_t step, checkpoint_loss_t loss,
+                                   void *ctx, const AD_REAL *initial_state,
+                                   size_t n_state, size_t n_steps,
+                                   size_t n_checkpoints, AD_REAL *grad) {
+  assert(n_state > 0);
+  checkpoint_t cp = {
+    .step = step,
+    .ctx = ctx,
+    .n_state = n_state,
+    .tape = tape_create(64),
+    .vars = (var_t *) malloc(n_state * sizeof(var_t)),
+    .checkpoints = (AD_REAL *) malloc((n_checkpoints > 0 ? n_checkpoints : 1) * n_state * sizeof(AD_REAL)),
+    .n_checkpoints = n_checkpoints,
+    .work = (AD_REAL *) malloc(n_state * sizeof(AD_REAL)),
+  };
+  if (cp.vars == NULL || cp.checkpoints == NULL || cp.work == NULL) {
+    perror("checkpoint malloc");
+    exit(1);
+    return 0;
+  }
+  tape_t *loaded_tape = tape_loaded();
+  tape_load(cp.tape);
+
+  /* forward sweep to the final state, the loss gives its adjoint */
+  memcpy(grad, initial_state, n_state * sizeof(AD_REAL));
+  checkpoint_advance(&cp, grad, 0, n_steps);
+  tape_clear(cp.tape);
+  for (size_t k = 0; k < n_state; ++k)
+    cp.vars[k] = var_create(grad[k]);
+  var_t out = loss(cp.vars, ctx);
+  tape_reverse_pass(cp.tape, out);
+  AD_REAL value = var_value(out);
+  for (size_t k = 0; k < n_state; ++k)
+    grad[k] = var_adjoint(cp.vars[k]);
+
+  if (n_steps > 0)
+    checkpoint_reverse(&cp, initial_state, 0, n_steps, n_checkpoints, grad);
+
+  tape_load(loaded_tape);
+  tape_destroy(cp.tape);
+  free(cp.vars);
+  free(cp.checkpoints);
+  free(cp.work);
+  return value;
+}
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ * ============================================================================
+ * C++ Code Generation From a Recorded Tape
+ * ============================================================================
+ * This header turns a tape recorded with `reverse.h` into the C++ source of a
+ * function that computes the value of the output and its gradient with respect
+ * to chosen inputs. The generated function is straight-line code: there is no
+ * tape and no dispatch on the operators, which lets the compiler keep the
+ * values in registers and optimize across entries.
+ *
+ * While generating the code:
+ *  - entries that do not depend on any input are folded into literals with the
+ *    value they had when recorded,
+ *  - entries the output does not depend on are removed,
+ *  - adjoints are only computed for the entries that remain.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To generate a function `f_grad` for f(x, y) = sin(x) * y + 2:
+ *   tape_t *tape = tape_create(64);
+ *   tape_load(tape);
+ *   var_t inputs[2] = {var_create(1.0f), var_create(2.0f)};
+ *   var_t f = var_sin(inputs[0]) * inputs[1] + var_create(2.0f);
+ *   codegen_write(stdout, "f_grad", tape, inputs, 2, f);
+ *
+ * The generated function has the signature
+ *   static float f_grad(const float *inputs, float *grad);
+ * it stores ∂f/∂inputs[k] in `grad[k]` and returns f.
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - Every entry recorded with `var_create` that is not one of the inputs is
+ *    treated as a constant. The inputs must be distinct variables.
+ *  - Branches taken on the values while recording are frozen in the generated
+ *    code.
+ *  - The generated code uses the `AD_REAL` type the tape was recorded with.
+ *  - Preaccumulated entries (`var_preaccumulate`) hold partial derivatives
+ *    that can not be recomputed from new inputs, their tapes are rejected.
+ */
+
+#ifndef H_REVERSE_CODEGEN
+#define H_REVERSE_CODEGEN
+
+#include "reverse.h"
+
+#define CODEGEN_STRINGIFY(x) #x
+#define CODEGEN_STR(x) CODEGEN_STRINGIFY(x)
+#define CODEGEN_REAL CODEGEN_STR(AD_REAL)
+
+/* enough for a variable name or a literal */
+#define CODEGEN_OPERAND_SIZE 64
+
+/*
+ * write in `buffer` the literal of `value`, non-finite values use the macros
+ * of <math.h> as `%g` prints them as `inf` and `nan`
+ */
+static const char *codegen_literal(char buffer[CODEGEN_OPERAND_SIZE], AD_REAL value) {
+  if (isnan(value))
+    snprintf(buffer, CODEGEN_OPERAND_SIZE, "((" CODEGEN_REAL ") NAN)");
+  else if (isinf(value))
+    snprintf(buffer, CODEGEN_OPERAND_SIZE, "((" CODEGEN_REAL ") %sINFINITY)", value < 0 ? "-" : "");
+  else
+    snprintf(buffer, CODEGEN_OPERAND_SIZE, "((" CODEGEN_REAL ") %.*g)",
+             sizeof(AD_REAL) > sizeof(float) ? 17 : 9, (double) value);
+  return buffer;
+}
+
+/*
+ * write in `buffer` the expression of the value of entry `i`, the name of its
+ * variable or a literal if it does not depend on the inputs
+ */
+static const char *codegen_operand(char buffer[CODEGEN_OPERAND_SIZE], tape_t *tape,
+                                   const bool *varied, uint32_t i) {
+  if (!varied[i])
+    return codegen_literal(buffer, tape_value(tape, i));
+  snprintf(buffer, CODEGEN_OPERAND_SIZE, "v%u", i);
+  return buffer;
+}
+
+/*
+ * write in `buffer` the expression of the second operand of entry `i`, its
+ * constant or its right parent
+ */
+static const char *codegen_right(char buffer[CODEGEN_OPERAND_SIZE], tape_t *tape,
+                                 const bool *varied, uint32_t i) {
+  operator_t op = tape_op(tape, i);
+  if (operator_constant(op))
+    return codegen_literal(buffer, tape_constant(tape, i));
+  if (operator_parents(op) == 2)
+    return codegen_operand(buffer, tape, varied, tape_right(tape, i));
+  buffer[0] = '\0';
+  return buffer;
+}
+
+/*
+ * write in `buffer` the expression of the `m`-th element of the side arrays as
+ * a factor of the `SUM` or `DOT` entry `i`, its constant or its other operand
+ */
+static const char *codegen_factor(char buffer[CODEGEN_OPERAND_SIZE], tape_t *tape,
+                                  const bool *varied, uint32_t i, uint32_t m) {
+  if (tape_op(tape, i) == SUM)
+    return codegen_literal(buffer, tape->multi_partials[m]);
+  uint32_t start = tape_multi_start(tape, i);
+  return codegen_operand(buffer, tape, varied, tape->multi_parents[start + ((m - start) ^ 1)]);
+}
+
+/* write the statement computing the value of the `SUM` or `DOT` entry `i` */
+static void codegen_primal_multi(FILE *out, tape_t *tape, const bool *varied, uint32_t i) {
+  char operand[CODEGEN_OPERAND_SIZE], factor[CODEGEN_OPERAND_SIZE];
+  uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+  uint32_t step = tape_op(tape, i) == DOT ? 2 : 1;  /* a dot product term has two operands */
+  fprintf(out, "  " CODEGEN_REAL " v%u = 0", i);
+  for (uint32_t m = start; m < end; m += step)
+    fprintf(out, " + %s * %s", codegen_operand(operand, tape, varied, tape->multi_parents[m]),
+            codegen_factor(factor, tape, varied, i, m));
+  fprintf(out, ";\n");
+}
+
+/* write the statement computing the value of entry `i` */
+static void codegen_primal(FILE *out, tape_t *tape, const bool *varied, uint32_t i) {
+  if (operator_multi(tape_op(tape, i))) {
+    codegen_primal_multi(out, tape, varied, i);
+    return;
+  }
+  char left[CODEGEN_OPERAND_SIZE], right[CODEGEN_OPERAND_SIZE];
+  const char *l = codegen_operand(left, tape, varied, tape_left(tape, i));
+  const char *r = codegen_right(right, tape, varied, i);
+  fprintf(out, "  " CODEGEN_REAL " v%u = ", i);
+  switch (tape_op(tape, i)) {
+    case NIL:
+      break;
+    case NEG:
+      fprintf(out, "-%s;\n", l);
+      break;
+    case ADD:
+      fprintf(out, "%s + %s;\n", l, r);
+      break;
+    case SUB:
+      fprintf(out, "%s - %s;\n", l, r);
+      break;
+    case MUL:
+      fprintf(out, "%s * %s;\n", l, r);
+      break;
+    case DIV:
+      fprintf(out, "%s / %s;\n", l, r);
+      break;
+    case POW:
+      fprintf(out, "pow(%s, %s);\n", l, r);
+      break;
+    case EXP:
+      fprintf(out, "exp(%s);\n", l);
+      break;
+    case COS:
+      fprintf(out, "cos(%s);\n", l);
+      break;
+    case SIN:
+      fprintf(out, "sin(%s);\n", l);
+      break;
+    case SQRT:
+      fprintf(out, "sqrt(%s);\n", l);
+      break;
+    case ADD_CONST:
+      fprintf(out, "%s + %s;\n", l, r);
+      break;
+    case CONST_SUB:
+      fprintf(out, "%s - %s;\n", r, l);
+      break;
+    case MUL_CONST:
+      fprintf(out, "%s * %s;\n", l, r);
+      break;
+    case DIV_CONST:
+      fprintf(out, "%s / %s;\n", l, r);
+      break;
+    case CONST_DIV:
+      fprintf(out, "%s / %s;\n", r, l);
+      break;
+    case POW_CONST:
+      fprintf(out, "pow(%s, %s);\n", l, r);
+      break;
+    case CONST_POW:
+      fprintf(out, "pow(%s, %s);\n", r, l);
+      break;
+    case MULTI:  /* rejected by `codegen_write` */
+    case SUM:  /* see `codegen_primal_multi` */
+    case DOT:
+      break;
+  }
+}
+
+/* add to the adjoint of `parent` the adjoint of `i` times `partial` */
+static void codegen_accumulate(FILE *out, bool *declared, uint32_t parent,
+                               uint32_t i, const char *partial) {
+  if (declared[parent]) {
+    fprintf(out, "  a%u += a%u * (%s);\n", parent, i, partial);
+  } else {
+    fprintf(out, "  " CODEGEN_REAL " a%u = a%u * (%s);\n", parent, i, partial);
+    declared[parent] = true;
+  }
+}
+
+/*
+ * write the statements propagating the adjoint of entry `i` to its parents
+ * that depend on the inputs, the partial derivatives are the ones of
+ * `tape_partials`
+ */
+static void codegen_adjoint(FILE *out, tape_t *tape, const bool *varied,
+                            bool *declared, uint32_t i) {
+  if (operator_multi(tape_op(tape, i))) {
+    /* the partial of each operand is its factor */
+    char factor[CODEGEN_OPERAND_SIZE];
+    uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+    for (uint32_t m = start; m < end; ++m)
+      if (varied[tape->multi_parents[m]])
+        codegen_accumulate(out, declared, tape->multi_parents[m], i,
+                           codegen_factor(factor, tape, varied, i, m));
+    return;
+  }
+  char left[CODEGEN_OPERAND_SIZE], right[CODEGEN_OPERAND_SIZE];
+  char left_partial[4 * CODEGEN_OPERAND_SIZE], right_partial[4 * CODEGEN_OPERAND_SIZE];
+  uint32_t left_parent = tape_left(tape, i);
+  uint32_t right_parent = tape_right(tape, i);
+  const char *l = codegen_operand(left, tape, varied, left_parent);
+  const char *r = codegen_right(right, tape, varied, i);
+  size_t size = sizeof(left_partial);
+
+  switch (tape_op(tape, i)) {
+    case NIL:
+      return;
+    case NEG:
+      snprintf(left_partial, size, "-1");
+      break;
+    case ADD:
+      snprintf(left_partial, size, "1");
+      snprintf(right_partial, size, "1");
+      break;
+    case SUB:
+      snprintf(left_partial, size, "1");
+      snprintf(right_partial, size, "-1");
+      break;
+    case MUL:
+      snprintf(left_partial, size, "%s", r);
+      snprintf(right_partial, size, "%s", l);
+      break;
+    case DIV:
+      snprintf(left_partial, size, "1 / %s", r);
+      snprintf(right_partial, size, "-1 * (v%u / %s)", i, r);
+      break;
+    case POW:
+      snprintf(left_partial, size, "%s * (v%u / %s)", r, i, l);
+      snprintf(right_partial, size, "v%u * log(%s)", i, l);
+      break;
+    case EXP:
+      snprintf(left_partial, size, "v%u", i);
+      break;
+    case COS:
+      snprintf(left_partial, size, "-1 * sqrt(1 - v%u*v%u)", i, i);
+      break;
+    case SIN:
+      snprintf(left_partial, size, "sqrt(1 - v%u*v%u)", i, i);
+      break;
+    case SQRT:
+      snprintf(left_partial, size, "1 / (2 * v%u)", i);
+      break;
+    case ADD_CONST:
+      snprintf(left_partial, size, "1");
+      break;
+    case CONST_SUB:
+      snprintf(left_partial, size, "-1");
+      break;
+    case MUL_CONST:
+      snprintf(left_partial, size, "%s", r);
+      break;
+    case DIV_CONST:
+      snprintf(left_partial, size, "1 / %s", r);
+      break;
+    case CONST_DIV:
+      snprintf(left_partial, size, "-1 * (v%u / %s)", i, l);
+      break;
+    case POW_CONST:
+      snprintf(left_partial, size, "%s * (v%u / %s)", r, i, l);
+      break;
+    case CONST_POW:
+      snprintf(left_partial, size, "v%u * log(%s)", i, r);
+      break;
+    case MULTI:  /* rejected by `codegen_write` */
+    case SUM:  /* handled above */
+    case DOT:
+      break;
+  }
+
+  if (varied[left_parent])
+    codegen_accumulate(out, declared, left_parent, i, left_partial);
+  if (operator_parents(tape_op(tape, i)) == 2 && varied[right_parent])
+    codegen_accumulate(out, declared, right_parent, i, right_partial);
+}
+
+/*
+ * write to `out` the definition of the function `name` computing `output` and
+ * its gradient with respect to the `n_inputs` variables `inputs`, from the
+ * entries recorded on `tape`
+ */
+static void codegen_write(FILE *out, const char *name, tape_t *tape,
+                          const var_t *inputs, size_t n_inputs, var_t output) {
+  assert(output.index < tape->length);
+  size_t length = output.index + 1;  /* later entries cannot be used */
+  bool *varied = (bool *) calloc(length, sizeof(bool));
+  bool *live = (bool *) calloc(length, sizeof(bool));
+  bool *declared = (bool *) calloc(length, sizeof(bool));
+  if (varied == NULL || live == NULL || declared == NULL) {
+    perror("codegen malloc");
+    exit(1);
+    return;
+  }
+
+  /* entries depending on the inputs, the parents are recorded before */
+  for (size_t k = 0; k < n_inputs; ++k) {
+    assert(tape_op(tape, inputs[k].index) == NIL);
+    if (inputs[k].index < length)
+      varied[inputs[k].index] = true;
+  }
+  for (size_t i = 0; i < length; ++i) {
+    operator_t op = tape_op(tape, i);
+    if (op == MULTI) {
+      fprintf(stderr, "codegen: preaccumulated entries can not be generated\n");
+      exit(1);
+    }
+    if (operator_multi(op)) {
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      for (uint32_t m = start; m < end; ++m)
+        varied[i] = varied[i] || varied[tape->multi_parents[m]];
+    } else if (op != NIL) {
+      varied[i] = varied[tape_left(tape, i)] ||
+                  (operator_parents(op) == 2 && varied[tape_right(tape, i)]);
+    }
+  }
+
+  /* entries the output depends on */
+  live[output.index] = true;
+  for (size_t i = length; i-- > 0;) {  /* avoid size_t wraps */
+    operator_t op = tape_op(tape, i);
+    if (!live[i] || op == NIL)
+      continue;
+    if (operator_multi(op)) {
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      for (uint32_t m = start; m < end; ++m)
+        live[tape->multi_parents[m]] = true;
+      continue;
+    }
+    live[tape_left(tape, i)] = true;
+    if (operator_parents(op) == 2)
+      live[tape_right(tape, i)] = true;
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < length; ++i)
+    kept += varied[i] && live[i];
+
+  fprintf(out, "/* generated from a tape of %u entries, %zu kept */\n", tape->length, kept);
+  fprintf(out, "#include <math.h>\n\n");
+  fprintf(out, "static " CODEGEN_REAL " %s(const " CODEGEN_REAL " *inputs, "
+          CODEGEN_REAL " *grad) {\n", name);
+
+  for (size_t k = 0; k < n_inputs; ++k) {
+    uint32_t i = inputs[k].index;
+    if (i < length && live[i])
+      fprintf(out, "  " CODEGEN_REAL " v%u = inputs[%zu];\n", i, k);
+  }
+  for (size_t i = 0; i < length; ++i)
+    if (varied[i] && live[i] && tape_op(tape, i) != NIL)
+      codegen_primal(out, tape, varied, i);
+
+  if (varied[output.index]) {
+    fprintf(out, "\n  " CODEGEN_REAL " a%u = 1;\n", output.index);
+    declared[output.index] = true;
+    for (size_t i = length; i-- > 0;)  /* avoid size_t wraps */
+      if (varied[i] && live[i])
+        codegen_adjoint(out, tape, varied, declared, i);
+  }
+
+  fprintf(out, "\n");
+  for (size_t k = 0; k < n_inputs; ++k) {
+    uint32_t i = inputs[k].index;
+    if (i < length && declared[i]) {
+      fprintf(out, "  grad[%zu] = a%u;\n", k, i);
+    } else {
+      fprintf(out, "  grad[%zu] = 0;\n", k);
+    }
+  }
+  char result[CODEGEN_OPERAND_SIZE];
+  fprintf(out, "  return %s;\n}\n", codegen_operand(result, tape, varied, output.index));
+
+  free(varied);
+  free(live);
+  free(declared);
+}
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ * ============================================================================
+ * Tape Files With Zero-Copy Loading
+ * ============================================================================
+ * This header saves a tape recorded with `reverse.h` to a binary file and
+ * loads it back by mapping the file in memory: the arrays of the loaded tape
+ * point directly into the mapping, there is no parsing nor copy, and the pages
+ * of the file are shared by all the processes that load it until they are
+ * written to.
+ *
+ * A graph can then be recorded once by one process and differentiated by many
+ * worker processes without running the primal computation again.
+ *
+ * File Format:
+ * ----------------------------------------------------------------------------
+ * A `tape_file_header_t` followed by sections aligned on `TAPE_FILE_ALIGN`
+ * bytes, in the layout of the tape in memory:
+ *  - with `TAPE_SOA`, the `values`, `left_parents`, `right_operands` and `ops`
+ *    arrays, the adjoints are not saved,
+ *  - otherwise the `entries` array,
+ * followed by the `multi_parents` and `multi_partials` side arrays of the
+ * preaccumulated entries. The sections hold `length` elements, the side arrays
+ * `multi_length`. The values are stored as `AD_REAL`
+ * in the byte order of the machine, a file can only be loaded by a program
+ * built with the same layout, `AD_REAL` and byte order.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ *   // recording process
+ *   tape_t *tape = tape_create(64);
+ *   tape_load(tape);
+ *   var_t x = var_create(1.0f);
+ *   var_t f = var_sin(x) * x;
+ *   tape_file_save("f.tape", tape);
+ *
+ *   // worker process, x and f are entries 0 and 2 of the saved tape
+ *   tape_file_t *file = tape_file_load("f.tape");
+ *   tape_load(file->tape);
+ *   var_t x = {0}, f = {2};
+ *   tape_reverse_pass(file->tape, f);
+ *   // var_adjoint(x) returns ∂f/∂x
+ *   tape_file_close(file);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - A loaded tape can be differentiated and its values modified, the changes
+ *    stay private to the process, but nothing can be recorded on it: its
+ *    `mapped` field is set and recording on it fails an assertion.
+ *  - The indices of the entries are kept, the variables of the recording
+ *    process designate the same entries in the loaded tape.
+ *  - POSIX only.
+ */
+
+#ifndef H_REVERSE_FILE
+#define H_REVERSE_FILE
+
+#include "reverse.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TAPE_FILE_VERSION 2
+#define TAPE_FILE_ALIGN 64
+#define TAPE_FILE_BYTE_ORDER 0x01020304
+
+static const char TAPE_FILE_MAGIC[8] = {'A', 'D', 'T', 'A', 'P', 'E', '\0', '\0'};
+
+typedef enum {
+  TAPE_FILE_AOS = 0,
+  TAPE_FILE_SOA,
+} tape_file_layout_t;
+
+#ifdef TAPE_SOA
+#define TAPE_FILE_LAYOUT TAPE_FILE_SOA
+#define TAPE_FILE_SECTIONS 6
+#else
+#define TAPE_FILE_LAYOUT TAPE_FILE_AOS
+#define TAPE_FILE_SECTIONS 3
+#endif
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;  /* `TAPE_FILE_BYTE_ORDER` as written by the machine */
+  uint32_t layout;  /* a `tape_file_layout_t` */
+  uint32_t real_size;  /* sizeof(AD_REAL) */
+  uint32_t entry_size;  /* sizeof(tape_entry_t) or sizeof(tape_operand_t) */
+  uint32_t length;
+  uint32_t multi_length;
+  uint64_t offsets[TAPE_FILE_SECTIONS];  /* of each section from the file start */
+} tape_file_header_t;
+
+typedef struct {
+  tape_t *tape;
+  void *map;
+  size_t map_size;
+} tape_file_t;
+
+static uint32_t tape_file_entry_size() {
+#ifdef TAPE_SOA
+  return sizeof(tape_operand_t);
+#else
+  return sizeof(tape_entry_t);
+#endif
+}
+
+/* pointer, element size and number of elements of each section of `tape` */
+static void tape_file_sections(tape_t *tape, void *arrays[TAPE_FILE_SECTIONS],
+                               size_t elem_sizes[TAPE_FILE_SECTIONS],
+                               uint32_t lengths[TAPE_FILE_SECTIONS]) {
+  for (int s = 0; s < TAPE_FILE_SECTIONS-2; ++s)
+    lengths[s] = tape->length;
+#ifdef TAPE_SOA
+  arrays[0] = tape->values;
+  elem_sizes[0] = sizeof(AD_REAL);
+  arrays[1] = tape->left_parents;
+  elem_sizes[1] = sizeof(uint32_t);
+  arrays[2] = tape->right_operands;
+  elem_sizes[2] = sizeof(tape_operand_t);
+  arrays[3] = tape->ops;
+  elem_sizes[3] = sizeof(uint8_t);
+#else
+  arrays[0] = tape->entries;
+  elem_sizes[0] = sizeof(tape_entry_t);
+#endif
+  arrays[TAPE_FILE_SECTIONS-2] = tape->multi_parents;
+  elem_sizes[TAPE_FILE_SECTIONS-2] = sizeof(uint32_t);
+  lengths[TAPE_FILE_SECTIONS-2] = tape->multi_length;
+  arrays[TAPE_FILE_SECTIONS-1] = tape->multi_partials;
+  elem_sizes[TAPE_FILE_SECTIONS-1] = sizeof(AD_REAL);
+  lengths[TAPE_FILE_SECTIONS-1] = tape->multi_length;
+}
+
+static uint64_t tape_file_align(uint64_t offset) {
+  return (offset + TAPE_FILE_ALIGN-1) / TAPE_FILE_ALIGN * TAPE_FILE_ALIGN;
+}
+
+/* write the entries of `tape` to the file `path` */
+static void tape_file_save(const char *path, tape_t *tape) {
+  void *arrays[TAPE_FILE_SECTIONS];
+  size_t elem_sizes[TAPE_FILE_SECTIONS];
+  uint32_t lengths[TAPE_FILE_SECTIONS];
+  tape_file_sections(tape, arrays, elem_sizes, lengths);
+
+  tape_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TAPE_FILE_MAGIC, sizeof(header.magic));
+  header.version = TAPE_FILE_VERSION;
+  header.byte_order = TAPE_FILE_BYTE_ORDER;
+  header.layout = TAPE_FILE_LAYOUT;
+  header.real_size = sizeof(AD_REAL);
+  header.entry_size = tape_file_entry_size();
+  header.length = tape->length;
+  header.multi_length = tape->multi_length;
+  uint64_t offset = tape_file_align(sizeof(header));
+  for (int s = 0; s < TAPE_FILE_SECTIONS; ++s) {
+    header.offsets[s] = offset;
+    offset = tape_file_align(offset + (uint64_t) lengths[s] * elem_sizes[s]);
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    perror("tape fopen");
+    exit(1);
+    return;
+  }
+  static const char padding[TAPE_FILE_ALIGN] = {0};
+  uint64_t written = fwrite(&header, 1, sizeof(header), file);
+  for (int s = 0; s < TAPE_FILE_SECTIONS; ++s) {
+    written += fwrite(padding, 1, header.offsets[s] - written, file);
+    if (lengths[s] > 0)
+      written += fwrite(arrays[s], 1, (size_t) lengths[s] * elem_sizes[s], file);
+  }
+  written += fwrite(padding, 1, offset - written, file);
+  if (written != offset || fclose(file)) {
+    perror("tape fwrite");
+    exit(1);
+  }
+}
+
+/* exit with `message` if the loaded file `path` is not a valid tape file */
+static void tape_file_check(bool valid, const char *path, const char *message) {
+  if (!valid) {
+    fprintf(stderr, "tape file %s: %s\n", path, message);
+    exit(1);
+  }
+}
+
+/* map the tape file `path`, the tape is accessed through `file->tape` */
+static tape_file_t *tape_file_load(const char *path) {
+  int fd = open(path, O_RDONLY);
+  struct stat stat;
+  if (fd < 0 || fstat(fd, &stat)) {
+    perror("tape open");
+    exit(1);
+    return NULL;
+  }
+  size_t map_size = (size_t) stat.st_size;
+  tape_file_check(map_size >= sizeof(tape_file_header_t), path, "truncated header");
+  /* private, the values and the adjoints can be written without changing the file */
+  void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("tape mmap");
+    exit(1);
+    return NULL;
+  }
+
+  const tape_file_header_t *header = (const tape_file_header_t *) map;
+  tape_file_check(!memcmp(header->magic, TAPE_FILE_MAGIC, sizeof(header->magic)), path, "not a tape file");
+  tape_file_check(header->version == TAPE_FILE_VERSION, path, "unsupported version");
+  tape_file_check(header->byte_order == TAPE_FILE_BYTE_ORDER, path, "different byte order");
+  tape_file_check(header->layout == TAPE_FILE_LAYOUT, path, "different tape layout, see TAPE_SOA");
+  tape_file_check(header->real_size == sizeof(AD_REAL), path, "different AD_REAL");
+  tape_file_check(header->entry_size == tape_file_entry_size(), path, "different entry size");
+  tape_file_check(header->length > 0 && header->length <= MAX_TAPE_LENGTH, path, "invalid length");
+
+  tape_t *tape = (tape_t *) malloc(sizeof(tape_t));
+  tape_file_t *file = (tape_file_t *) malloc(sizeof(tape_file_t));
+  if (tape == NULL || file == NULL) {
+    perror("tape malloc");
+    exit(1);
+    return NULL;
+  }
+  memset(tape, 0, sizeof(tape_t));
+  tape->length = header->length;
+  tape->capacity = header->length;
+  tape->multi_length = header->multi_length;
+  tape->multi_capacity = header->multi_length;
+  tape->mapped = true;  /* the arrays can not be reallocated */
+
+  /* point the arrays of the tape to the sections */
+  char *base = (char *) map;
+  void *arrays[TAPE_FILE_SECTIONS];
+  size_t elem_sizes[TAPE_FILE_SECTIONS];
+  uint32_t lengths[TAPE_FILE_SECTIONS];
+  tape_file_sections(tape, arrays, elem_sizes, lengths);
+  for (int s = 0; s < TAPE_FILE_SECTIONS; ++s) {
+    uint64_t offset = header->offsets[s];
+    tape_file_check(offset % TAPE_FILE_ALIGN == 0 &&
+                    offset + (uint64_t) lengths[s] * elem_sizes[s] <= map_size,
+                    path, "invalid section");
+  }
+#ifdef TAPE_SOA
+  tape->values = (AD_REAL *) (base + header->offsets[0]);
+  tape->left_parents = (uint32_t *) (base + header->offsets[1]);
+  tape->right_operands = (tape_operand_t *) (base + header->offsets[2]);
+  tape->ops = (uint8_t *) (base + header->offsets[3]);
+  tape->adjoints = (AD_REAL *) calloc(header->length, sizeof(AD_REAL));
+  if (tape->adjoints == NULL) {
+    perror("tape malloc");
+    exit(1);
+    return NULL;
+  }
+#ifdef TAPE_SPILL
+  tape->spill_fd = -1;  /* the mapping is already backed by the file */
+#endif
+#else
+  tape->entries = (tape_entry_t *) (base + header->offsets[0]);
+#endif
+  tape->multi_parents = (uint32_t *) (base + header->offsets[TAPE_FILE_SECTIONS-2]);
+  tape->multi_partials = (AD_REAL *) (base + header->offsets[TAPE_FILE_SECTIONS-1]);
+
+  *file = {
+    .tape = tape,
+    .map = map,
+    .map_size = map_size,
+  };
+  return file;
+}
+
+static void tape_file_close(tape_file_t *file) {
+#ifdef TAPE_SOA
+  free(file->tape->adjoints);
+#endif
+#ifdef ADJLEN
+  free(file->tape->adjvecs);
+#endif
+  munmap(file->map, file->map_size);
+  free(file->tape);
+  free(file);
+}
+
+#endif
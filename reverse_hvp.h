@@ -0,0 +1,237 @@
+/*
+ * ============================================================================
+ * Hessian-Vector Products With Forward-Over-Reverse
+ * ============================================================================
+ * This header computes H·v, the product of the Hessian of a recorded output
+ * with a direction v, from a tape recorded with `reverse.h`, for about twice
+ * the cost of a gradient.
+ *
+ * Every entry of the tape is given a tangent, the derivative of its value in
+ * the direction v, computed by a forward sweep over the tape. The reverse
+ * sweep then propagates the adjoints together with their own tangents: the
+ * tangent of the adjoint of an input is the component of H·v for this input.
+ * This is the reverse pass applied to dual numbers whose second component is
+ * the tangent, without recording dual numbers: the tangents are kept in arrays
+ * next to the tape.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute H·v for f(x, y) = x² y at (1, 2) and v = (1, 0):
+ *   tape_t *tape = tape_create(64);
+ *   tape_load(tape);
+ *   var_t inputs[2] = {var_create(1.0f), var_create(2.0f)};
+ *   var_t f = inputs[0] * inputs[0] * inputs[1];
+ *   float v[2] = {1, 0};
+ *   hvp_t *hvp = hvp_create();
+ *   hvp_pass(hvp, tape, f, inputs, v, 2);
+ *   // hvp_value(hvp, inputs[0]) returns 4, hvp_value(hvp, inputs[1]) 2
+ *   // var_adjoint(inputs[k]) returns ∂f/∂inputs[k]
+ *   hvp_destroy(hvp);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - `hvp_pass` also computes the gradient, as `tape_reverse_pass` does.
+ *  - An `hvp_t` can be reused for any number of passes and tapes.
+ *  - Preaccumulated entries (`var_preaccumulate`) only hold first order
+ *    partial derivatives, their tapes are rejected.
+ */
+
+#ifndef H_REVERSE_HVP
+#define H_REVERSE_HVP
+
+#include "reverse.h"
+
+typedef struct {
+  uint32_t capacity;
+  AD_REAL *tangents;  /* derivative of the value of each entry in the direction */
+  AD_REAL *adjoint_tangents;  /* derivative of the adjoint of each entry */
+} hvp_t;
+
+static hvp_t *hvp_create() {
+  hvp_t *hvp = (hvp_t *) malloc(sizeof(hvp_t));
+  if (hvp == NULL) {
+    perror("hvp malloc");
+    exit(1);
+    return NULL;
+  }
+  *hvp = {
+    .capacity = 0,
+    .tangents = NULL,
+    .adjoint_tangents = NULL,
+  };
+  return hvp;
+}
+
+static void hvp_destroy(hvp_t *hvp) {
+  free(hvp->tangents);
+  free(hvp->adjoint_tangents);
+  free(hvp);
+}
+
+/*
+ * store in `left_partial_tangent` and `right_partial_tangent` the derivatives
+ * in the direction of the partial derivatives given by `tape_partials` for
+ * entry `i`
+ */
+static inline void hvp_partial_tangents(tape_t *tape, const AD_REAL *tangents, uint32_t i,
+                                        AD_REAL *left_partial_tangent,
+                                        AD_REAL *right_partial_tangent) {
+  operator_t op = tape_op(tape, i);
+  uint32_t left = tape_left(tape, i);
+  uint32_t right = operator_parents(op) == 2 ? tape_right(tape, i) : left;
+  AD_REAL value = tape_value(tape, i), tangent = tangents[i];
+  AD_REAL l = tape_value(tape, left), left_tangent = tangents[left];
+  AD_REAL r = tape_value(tape, right), right_tangent = tangents[right];
+  *left_partial_tangent = 0;
+  *right_partial_tangent = 0;
+  switch (op) {
+    case NIL:
+    case NEG:
+    case ADD:
+    case SUB:
+    case ADD_CONST:
+    case CONST_SUB:
+    case MUL_CONST:
+    case DIV_CONST:
+      break;
+    case MUL:
+      *left_partial_tangent  = right_tangent;
+      *right_partial_tangent = left_tangent;
+      break;
+    case DIV:
+      *left_partial_tangent  = -right_tangent / (r*r);
+      *right_partial_tangent = -(tangent*r - value*right_tangent) / (r*r);
+      break;
+    case POW:
+      *left_partial_tangent  = right_tangent * (value / l) + r * (tangent*l - value*left_tangent) / (l*l);
+      *right_partial_tangent = tangent * log(l) + value * left_tangent / l;
+      break;
+    case EXP:
+      *left_partial_tangent = tangent;
+      break;
+    case COS:
+      *left_partial_tangent = value * tangent / sqrt(1 - value*value);
+      break;
+    case SIN:
+      *left_partial_tangent = -1 * value * tangent / sqrt(1 - value*value);
+      break;
+    case SQRT:
+      *left_partial_tangent = -tangent / (2 * value*value);
+      break;
+    case CONST_DIV:
+      *left_partial_tangent = -(tangent*l - value*left_tangent) / (l*l);
+      break;
+    case POW_CONST:
+      *left_partial_tangent = tape_constant(tape, i) * (tangent*l - value*left_tangent) / (l*l);
+      break;
+    case CONST_POW:
+      *left_partial_tangent = tangent * log(tape_constant(tape, i));
+      break;
+    case MULTI:  /* rejected by `hvp_pass` */
+    case SUM:  /* handled by `hvp_pass` */
+    case DOT:
+      break;
+  }
+}
+
+/*
+ * compute the gradient of `output`, read with `var_adjoint`, and its product
+ * with the Hessian of `output` in the direction `direction` of the `n_inputs`
+ * variables `inputs`, read with `hvp_value`
+ */
+static void hvp_pass(hvp_t *hvp, tape_t *tape, var_t output, const var_t *inputs,
+                     const AD_REAL *direction, size_t n_inputs) {
+  if (hvp->capacity < tape->length) {
+    free(hvp->tangents);
+    free(hvp->adjoint_tangents);
+    hvp->tangents = (AD_REAL *) malloc(tape->capacity * sizeof(AD_REAL));
+    hvp->adjoint_tangents = (AD_REAL *) malloc(tape->capacity * sizeof(AD_REAL));
+    if (hvp->tangents == NULL || hvp->adjoint_tangents == NULL) {
+      perror("hvp malloc");
+      exit(1);
+      return;
+    }
+    hvp->capacity = tape->capacity;
+  }
+  AD_REAL *tangents = hvp->tangents;
+  AD_REAL *adjoint_tangents = hvp->adjoint_tangents;
+
+  /* forward sweep, the entries without parents are constants unless seeded */
+  size_t length = output.index + 1;
+  memset(tangents, 0, length * sizeof(AD_REAL));
+  for (size_t k = 0; k < n_inputs; ++k) {
+    assert(tape_op(tape, inputs[k].index) == NIL);
+    tangents[inputs[k].index] = direction[k];
+  }
+  for (size_t i = 0; i < length; ++i) {
+    operator_t op = tape_op(tape, i);
+    if (op == MULTI) {
+      fprintf(stderr, "hvp: preaccumulated entries have no second derivatives\n");
+      exit(1);
+    }
+    if (operator_multi(op)) {
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      tangents[i] = 0;
+      for (uint32_t m = start; m < end; ++m)
+        tangents[i] += tape->multi_partials[m] * tangents[tape->multi_parents[m]];
+      continue;
+    }
+    AD_REAL left_partial, right_partial;
+    int parents = tape_partials(tape, i, &left_partial, &right_partial);
+    if (parents == 0)
+      continue;
+    tangents[i] = left_partial * tangents[tape_left(tape, i)];
+    if (parents == 2)
+      tangents[i] += right_partial * tangents[tape_right(tape, i)];
+  }
+
+  /* reverse sweep on the adjoints and their tangents */
+  for (size_t i = 0; i < length; ++i)
+    tape_adjoint(tape, i) = 0;
+  memset(adjoint_tangents, 0, length * sizeof(AD_REAL));
+  tape_adjoint(tape, output.index) = 1;
+
+  for (size_t i = length; i-- > 0;) {  /* avoid size_t wraps */
+    operator_t op = tape_op(tape, i);
+    if (operator_multi(op)) {
+      /* the partials of a sum are constants, the one of a_k in a dot product is b_k */
+      AD_REAL adjoint = tape_adjoint(tape, i);
+      AD_REAL adjoint_tangent = adjoint_tangents[i];
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      for (uint32_t m = start; m < end; ++m) {
+        uint32_t parent = tape->multi_parents[m];
+        AD_REAL partial = tape->multi_partials[m];
+        AD_REAL partial_tangent = 0;
+        if (op == DOT)
+          partial_tangent = tangents[tape->multi_parents[start + ((m - start) ^ 1)]];
+        tape_adjoint(tape, parent) += adjoint * partial;
+        adjoint_tangents[parent] += adjoint_tangent * partial + adjoint * partial_tangent;
+      }
+      continue;
+    }
+    AD_REAL left_partial, right_partial;
+    int parents = tape_partials(tape, i, &left_partial, &right_partial);
+    if (parents == 0)
+      continue;
+    AD_REAL left_partial_tangent, right_partial_tangent;
+    hvp_partial_tangents(tape, tangents, i, &left_partial_tangent, &right_partial_tangent);
+    AD_REAL adjoint = tape_adjoint(tape, i);
+    AD_REAL adjoint_tangent = adjoint_tangents[i];
+
+    uint32_t left = tape_left(tape, i);
+    tape_adjoint(tape, left) += adjoint * left_partial;
+    adjoint_tangents[left] += adjoint_tangent * left_partial + adjoint * left_partial_tangent;
+    if (parents == 2) {
+      uint32_t right = tape_right(tape, i);
+      tape_adjoint(tape, right) += adjoint * right_partial;
+      adjoint_tangents[right] += adjoint_tangent * right_partial + adjoint * right_partial_tangent;
+    }
+  }
+}
+
+/* component of the last Hessian-vector product for the input `a` */
+static AD_REAL hvp_value(hvp_t *hvp, var_t a) {
+  return hvp->adjoint_tangents[a.index];
+}
+
+#endif
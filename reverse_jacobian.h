@@ -0,0 +1,297 @@
+/*
+ * ============================================================================
+ * Jacobians With Automatic Forward/Reverse Mode Selection
+ * ============================================================================
+ * This header computes the Jacobian of a function of `n_in` inputs and `n_out`
+ * outputs. The function is recorded once on a tape with `reverse.h`, then the
+ * Jacobian is computed from the tape in one of two ways:
+ *  - forward: the tangents of all the entries are propagated from the inputs,
+ *    `JACOBIAN_CHUNK` inputs at a time, each sweep gives `JACOBIAN_CHUNK`
+ *    columns of the Jacobian,
+ *  - reverse: the adjoints are propagated from each output (from `ADJLEN`
+ *    outputs at a time with `ADJLEN`), each sweep gives rows of the Jacobian.
+ *
+ * The mode whose sweeps cost the least according to the cost model is used.
+ * The cost of a sweep is the number of entries it goes through times the cost
+ * of an entry, `JACOBIAN_FORWARD_COST` and `JACOBIAN_REVERSE_COST`, which are
+ * measured on each machine by `benchmark/polynomial_approximation/
+ * benchmark_jacobian.sh`.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute the Jacobian of (x, y) -> (x y, sin(x), x + y) at (1, 2):
+ *   void f(const var_t *in, var_t *out, void *ctx) {
+ *     out[0] = in[0] * in[1];
+ *     out[1] = var_sin(in[0]);
+ *     out[2] = in[0] + in[1];
+ *   }
+ *   float inputs[2] = {1, 2}, values[3], jac[3 * 2];
+ *   jacobian(&f, NULL, inputs, 2, 3, values, jac);
+ *   // jac[o * 2 + i] is ∂out[o]/∂in[i]
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - The Jacobian is dense and stored row by row, one row per output.
+ *  - Every entry of the Jacobian needs either its column or its row, so
+ *    computing some columns forward and the other rows in reverse never costs
+ *    less than the cheapest mode for a dense Jacobian.
+ *  - `jacobian_with_mode` forces a mode, the calibration uses it.
+ *  - `fn` is recorded on a private tape, the tape loaded by the caller is
+ *    restored before returning.
+ */
+
+#ifndef H_REVERSE_JACOBIAN
+#define H_REVERSE_JACOBIAN
+
+#include "reverse.h"
+
+/* number of inputs whose tangents are propagated by one forward sweep */
+#ifndef JACOBIAN_CHUNK
+#define JACOBIAN_CHUNK 8
+#endif
+
+/* nanoseconds per entry of a forward and of a reverse sweep, see the header */
+#ifndef JACOBIAN_FORWARD_COST
+#define JACOBIAN_FORWARD_COST 19.0
+#endif
+#ifndef JACOBIAN_REVERSE_COST
+#define JACOBIAN_REVERSE_COST 6.5
+#endif
+
+#ifdef ADJLEN
+#define JACOBIAN_REVERSE_OUTPUTS ADJLEN
+#else
+#define JACOBIAN_REVERSE_OUTPUTS 1
+#endif
+
+typedef enum {
+  JACOBIAN_AUTO = 0,
+  JACOBIAN_FORWARD,
+  JACOBIAN_REVERSE,
+} jacobian_mode_t;
+
+/* record the `n_out` outputs of the function of the `n_in` variables `inputs` */
+typedef void (*jacobian_fn_t)(const var_t *inputs, var_t *outputs, void *ctx);
+
+/* number of entries up to the last output */
+static uint32_t jacobian_length(const var_t *outputs, size_t n_out) {
+  uint32_t length = 0;
+  for (size_t o = 0; o < n_out; ++o)
+    if (outputs[o].index+1 > length)
+      length = outputs[o].index+1;
+  return length;
+}
+
+/* number of entries the forward sweeps go through */
+static double jacobian_forward_entries(const var_t *outputs, size_t n_in, size_t n_out) {
+  size_t sweeps = (n_in + JACOBIAN_CHUNK-1) / JACOBIAN_CHUNK;
+  return (double) sweeps * jacobian_length(outputs, n_out);
+}
+
+/* number of entries the reverse sweeps go through */
+static double jacobian_reverse_entries(const var_t *outputs, size_t n_out) {
+  double entries = 0;
+  for (size_t o = 0; o < n_out; o += JACOBIAN_REVERSE_OUTPUTS) {
+    uint32_t last = 0;
+    for (size_t k = o; k < n_out && k < o + JACOBIAN_REVERSE_OUTPUTS; ++k)
+      if (outputs[k].index > last)
+        last = outputs[k].index;
+    entries += last+1;
+  }
+  return entries;
+}
+
+/* marks the entries whose parents are in the side arrays in `jacobian_forward_sweep` */
+#define JACOBIAN_MULTI 3
+
+/* cheapest mode for the recorded `outputs` of a function of `n_in` inputs */
+static jacobian_mode_t jacobian_select(const var_t *outputs, size_t n_in, size_t n_out) {
+  double forward = jacobian_forward_entries(outputs, n_in, n_out) * JACOBIAN_FORWARD_COST;
+  double reverse = jacobian_reverse_entries(outputs, n_out) * JACOBIAN_REVERSE_COST;
+  return forward < reverse ? JACOBIAN_FORWARD : JACOBIAN_REVERSE;
+}
+
+/*
+ * propagate the tangents of the `length` first entries of `tape` for the lanes
+ * `c` to `c + JACOBIAN_CHUNK-1`, input `i` is seeded in the lane `colors[i]`,
+ * or `i` if `colors` is NULL, several inputs may share a lane. The inputs are
+ * always seeded, `length` must be at least `n_in`.
+ */
+static void jacobian_forward_sweep(tape_t *tape, const uint8_t *parents,
+                                   const AD_REAL *partials, AD_REAL *tangents,
+                                   uint32_t length, size_t n_in,
+                                   const uint32_t *colors, size_t c) {
+  assert(length >= n_in);
+  for (size_t i = 0; i < n_in; ++i) {
+    size_t color = colors != NULL ? colors[i] : i;
+    for (size_t k = 0; k < JACOBIAN_CHUNK; ++k)
+      tangents[i * JACOBIAN_CHUNK + k] = (color == c+k);
+  }
+
+  for (uint32_t i = n_in; i < length; ++i) {
+    if (parents[i] == 0)
+      continue;  /* constant, its tangents stay 0 */
+    AD_REAL *tangent = tangents + (size_t) i * JACOBIAN_CHUNK;
+    if (parents[i] == JACOBIAN_MULTI) {
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      for (size_t k = 0; k < JACOBIAN_CHUNK; ++k)
+        tangent[k] = 0;
+      for (uint32_t m = start; m < end; ++m) {
+        const AD_REAL *parent = tangents + (size_t) tape->multi_parents[m] * JACOBIAN_CHUNK;
+        AD_REAL partial = tape->multi_partials[m];
+        for (size_t k = 0; k < JACOBIAN_CHUNK; ++k)
+          tangent[k] += partial * parent[k];
+      }
+      continue;
+    }
+    const AD_REAL *left = tangents + (size_t) tape_left(tape, i) * JACOBIAN_CHUNK;
+    AD_REAL left_partial = partials[2*i];
+    if (parents[i] == 2) {
+      const AD_REAL *right = tangents + (size_t) tape_right(tape, i) * JACOBIAN_CHUNK;
+      AD_REAL right_partial = partials[2*i+1];
+      for (size_t k = 0; k < JACOBIAN_CHUNK; ++k)
+        tangent[k] = left_partial * left[k] + right_partial * right[k];
+    } else {
+      for (size_t k = 0; k < JACOBIAN_CHUNK; ++k)
+        tangent[k] = left_partial * left[k];
+    }
+  }
+}
+
+/*
+ * allocate the arrays of `jacobian_forward_sweep` for the `length` first
+ * entries of `tape` and compute the partials, which do not depend on the seeds
+ */
+static void jacobian_forward_create(tape_t *tape, uint32_t length, uint8_t **parents,
+                                    AD_REAL **partials, AD_REAL **tangents) {
+  *parents = (uint8_t *) malloc(length * sizeof(uint8_t));
+  *partials = (AD_REAL *) malloc(2 * (size_t) length * sizeof(AD_REAL));
+  *tangents = (AD_REAL *) calloc((size_t) length * JACOBIAN_CHUNK, sizeof(AD_REAL));
+  if (*parents == NULL || *partials == NULL || *tangents == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return;
+  }
+  for (uint32_t i = 0; i < length; ++i) {
+    if (operator_multi(tape_op(tape, i)))  /* the partials are in the side arrays */
+      (*parents)[i] = JACOBIAN_MULTI;
+    else
+      (*parents)[i] = tape_partials(tape, i, &(*partials)[2*i], &(*partials)[2*i+1]);
+  }
+}
+
+/* columns of the Jacobian, the inputs are the first `n_in` entries of `tape` */
+static void jacobian_forward(tape_t *tape, const var_t *outputs, size_t n_in,
+                             size_t n_out, AD_REAL *jac) {
+  /* the outputs may all be recorded before the last input */
+  uint32_t length = jacobian_length(outputs, n_out);
+  if (length < n_in)
+    length = (uint32_t) n_in;
+  uint8_t *parents;
+  AD_REAL *partials, *tangents;
+  jacobian_forward_create(tape, length, &parents, &partials, &tangents);
+
+  for (size_t c = 0; c < n_in; c += JACOBIAN_CHUNK) {
+    /* lane k is the tangent in the direction of input c+k */
+    jacobian_forward_sweep(tape, parents, partials, tangents, length, n_in, NULL, c);
+    for (size_t o = 0; o < n_out; ++o) {
+      const AD_REAL *tangent = tangents + (size_t) outputs[o].index * JACOBIAN_CHUNK;
+      for (size_t k = 0; k < JACOBIAN_CHUNK && c+k < n_in; ++k)
+        jac[o * n_in + c+k] = tangent[k];
+    }
+  }
+
+  free(parents);
+  free(partials);
+  free(tangents);
+}
+
+/* rows of the Jacobian, the inputs are the first `n_in` entries of `tape` */
+static void jacobian_reverse(tape_t *tape, const var_t *outputs, size_t n_in,
+                             size_t n_out, AD_REAL *jac) {
+#ifdef ADJLEN
+  for (size_t o = 0; o < n_out; o += ADJLEN) {
+    size_t n_starts = n_out - o < ADJLEN ? n_out - o : ADJLEN;
+    tape_reverse_pass_vec(tape, outputs + o, n_starts);
+    for (size_t i = 0; i < n_in; ++i) {
+      var_t input = {(uint32_t) i};
+      const AD_REAL *adjoint = var_adjoint_vec(input);
+      for (size_t k = 0; k < n_starts; ++k)
+        jac[(o+k) * n_in + i] = adjoint[k];
+    }
+  }
+#else
+  for (size_t o = 0; o < n_out; ++o) {
+    tape_reverse_pass(tape, outputs[o]);
+    for (size_t i = 0; i < n_in; ++i) {
+      var_t input = {(uint32_t) i};
+      jac[o * n_in + i] = var_adjoint(input);
+    }
+  }
+#endif
+}
+
+/*
+ * record `fn` at `inputs` on a new tape, which is loaded and returned, the
+ * inputs are its first `n_in` entries
+ */
+static tape_t *jacobian_record(jacobian_fn_t fn, void *ctx, const AD_REAL *inputs,
+                               size_t n_in, var_t *outputs) {
+  var_t *vars = (var_t *) malloc(n_in * sizeof(var_t));
+  if (vars == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return NULL;
+  }
+  tape_t *tape = tape_create(64);
+  tape_load(tape);
+  for (size_t i = 0; i < n_in; ++i)
+    vars[i] = var_create(inputs[i]);
+  fn(vars, outputs, ctx);
+  free(vars);
+  return tape;
+}
+
+/*
+ * store in `values` the `n_out` outputs of `fn` at `inputs` and in `jac` its
+ * Jacobian, row by row, computed in `mode`, returns the mode used
+ */
+static jacobian_mode_t jacobian_with_mode(jacobian_mode_t mode, jacobian_fn_t fn,
+                                          void *ctx, const AD_REAL *inputs,
+                                          size_t n_in, size_t n_out,
+                                          AD_REAL *values, AD_REAL *jac) {
+  assert(n_in > 0 && n_out > 0);
+  var_t *outputs = (var_t *) malloc(n_out * sizeof(var_t));
+  if (outputs == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return mode;
+  }
+  tape_t *loaded_tape = tape_loaded();
+  tape_t *tape = jacobian_record(fn, ctx, inputs, n_in, outputs);
+  for (size_t o = 0; o < n_out; ++o)
+    values[o] = var_value(outputs[o]);
+
+  if (mode == JACOBIAN_AUTO)
+    mode = jacobian_select(outputs, n_in, n_out);
+  if (mode == JACOBIAN_FORWARD)
+    jacobian_forward(tape, outputs, n_in, n_out, jac);
+  else
+    jacobian_reverse(tape, outputs, n_in, n_out, jac);
+
+  tape_load(loaded_tape);
+  tape_destroy(tape);
+  free(outputs);
+  return mode;
+}
+
+/*
+ * store in `values` the `n_out` outputs of `fn` at `inputs` and in `jac` its
+ * Jacobian, row by row, returns the mode used
+ */
+static jacobian_mode_t jacobian(jacobian_fn_t fn, void *ctx, const AD_REAL *inputs,
+                                size_t n_in, size_t n_out, AD_REAL *values, AD_REAL *jac) {
+  return jacobian_with_mode(JACOBIAN_AUTO, fn, ctx, inputs, n_in, n_out, values, jac);
+}
+
+#endif
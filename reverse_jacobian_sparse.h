@@ -0,0 +1,254 @@
+/*
+ * ============================================================================
+ * Sparse Jacobians With Column Coloring
+ * ============================================================================
+ * This header computes the Jacobians of functions whose outputs each depend on
+ * a few inputs only, e.g. banded or block-sparse Jacobians, with a number of
+ * forward sweeps that depends on the sparsity and not on the number of inputs.
+ *
+ * The sparsity pattern, the inputs each output depends on, is detected once by
+ * propagating bitsets of inputs through a recorded tape. The inputs are then
+ * colored so that two inputs sharing an output never have the same color,
+ * which is a greedy distance-2 coloring of the columns. The inputs of a color
+ * are structurally orthogonal, they are all seeded in the same tangent lane of
+ * the forward sweeps of `reverse_jacobian.h`, and each nonzero of the Jacobian
+ * is read from the lane of the color of its input. A tridiagonal Jacobian
+ * needs 3 colors, so a single sweep whatever the number of inputs.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute the Jacobian of out[o] = in[o-1] in[o] - sin(in[o+1]):
+ *   void f(const var_t *in, var_t *out, void *ctx) {
+ *     for (size_t o = 1; o+1 < 1000; ++o)
+ *       out[o-1] = in[o-1] * in[o] - var_sin(in[o+1]);
+ *   }
+ *   jacobian_pattern_t *pattern = jacobian_pattern_create(&f, NULL, inputs, 1000, 998);
+ *   // pattern->n_colors is 3
+ *   jacobian_sparse(pattern, &f, NULL, inputs, values, nonzeros);
+ *   // nonzeros[k] is ∂out[o]/∂in[pattern->columns[k]] for the k of row o,
+ *   // pattern->row_starts[o] <= k < pattern->row_starts[o+1]
+ *   jacobian_pattern_destroy(pattern);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - The nonzeros are stored row by row (compressed sparse rows), there are
+ *    `pattern->row_starts[n_out]` of them.
+ *  - The pattern is structural, it only holds for the inputs at which `fn`
+ *    records the same operations, i.e. takes the same branches.
+ *  - The detection takes one sweep over the tape per 64 inputs and does not
+ *    evaluate any derivative.
+ */
+
+#ifndef H_REVERSE_JACOBIAN_SPARSE
+#define H_REVERSE_JACOBIAN_SPARSE
+
+#include "reverse_jacobian.h"
+
+typedef struct {
+  size_t n_in;
+  size_t n_out;
+  size_t *row_starts;  /* the nonzeros of row o are row_starts[o] to row_starts[o+1]-1 */
+  uint32_t *columns;  /* input of each nonzero, increasing in each row */
+  uint32_t *colors;  /* color of each input */
+  size_t n_colors;
+} jacobian_pattern_t;
+
+/* allocate `pattern` with the inputs each of the recorded `outputs` depends on */
+static void jacobian_pattern_detect(jacobian_pattern_t *pattern, tape_t *tape,
+                                    const var_t *outputs) {
+  size_t n_in = pattern->n_in, n_out = pattern->n_out;
+  size_t n_blocks = (n_in + 63) / 64;
+  uint32_t length = jacobian_length(outputs, n_out);
+  uint64_t *masks = (uint64_t *) malloc(length * sizeof(uint64_t));
+  uint64_t *row_masks = (uint64_t *) malloc(n_out * n_blocks * sizeof(uint64_t));
+  pattern->row_starts = (size_t *) malloc((n_out+1) * sizeof(size_t));
+  if (masks == NULL || row_masks == NULL || pattern->row_starts == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return;
+  }
+
+  /* bit k of `masks[i]` is set if entry i depends on input 64 b + k */
+  for (size_t b = 0; b < n_blocks; ++b) {
+    for (uint32_t i = 0; i < length; ++i) {
+      operator_t op = tape_op(tape, i);
+      int parents = operator_parents(op);
+      if (i < n_in)
+        masks[i] = i / 64 == b ? (uint64_t) 1 << (i % 64) : 0;
+      else if (operator_multi(op)) {
+        uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+        masks[i] = 0;
+        for (uint32_t m = start; m < end; ++m)
+          masks[i] |= masks[tape->multi_parents[m]];
+      } else if (parents == 0)
+        masks[i] = 0;
+      else if (parents == 1)
+        masks[i] = masks[tape_left(tape, i)];
+      else
+        masks[i] = masks[tape_left(tape, i)] | masks[tape_right(tape, i)];
+    }
+    for (size_t o = 0; o < n_out; ++o)
+      row_masks[o * n_blocks + b] = masks[outputs[o].index];
+  }
+
+  size_t nonzeros = 0;
+  for (size_t o = 0; o < n_out; ++o) {
+    pattern->row_starts[o] = nonzeros;
+    for (size_t b = 0; b < n_blocks; ++b)
+      nonzeros += __builtin_popcountll(row_masks[o * n_blocks + b]);
+  }
+  pattern->row_starts[n_out] = nonzeros;
+
+  pattern->columns = (uint32_t *) malloc((nonzeros > 0 ? nonzeros : 1) * sizeof(uint32_t));
+  if (pattern->columns == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return;
+  }
+  size_t k = 0;
+  for (size_t o = 0; o < n_out; ++o) {
+    for (size_t b = 0; b < n_blocks; ++b) {
+      for (uint64_t mask = row_masks[o * n_blocks + b]; mask != 0; mask &= mask-1)
+        pattern->columns[k++] = b * 64 + __builtin_ctzll(mask);
+    }
+  }
+
+  free(masks);
+  free(row_masks);
+}
+
+/* greedy coloring of the inputs, two inputs of the same row differ in color */
+static void jacobian_pattern_color(jacobian_pattern_t *pattern) {
+  size_t n_in = pattern->n_in, n_out = pattern->n_out;
+  size_t nonzeros = pattern->row_starts[n_out];
+  size_t *column_starts = (size_t *) calloc(n_in+1, sizeof(size_t));
+  uint32_t *rows = (uint32_t *) malloc((nonzeros > 0 ? nonzeros : 1) * sizeof(uint32_t));
+  uint32_t *forbidden = (uint32_t *) malloc(n_in * sizeof(uint32_t));
+  pattern->colors = (uint32_t *) malloc(n_in * sizeof(uint32_t));
+  if (column_starts == NULL || rows == NULL || forbidden == NULL || pattern->colors == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return;
+  }
+
+  /* rows of each column, the transpose of the pattern */
+  for (size_t k = 0; k < nonzeros; ++k)
+    ++column_starts[pattern->columns[k] + 1];
+  for (size_t i = 0; i < n_in; ++i)
+    column_starts[i+1] += column_starts[i];
+  for (size_t o = 0; o < n_out; ++o)
+    for (size_t k = pattern->row_starts[o]; k < pattern->row_starts[o+1]; ++k)
+      rows[column_starts[pattern->columns[k]]++] = o;
+  for (size_t i = n_in; i > 0; --i)  /* the starts were advanced to the ends */
+    column_starts[i] = column_starts[i-1];
+  column_starts[0] = 0;
+
+  /* `forbidden[c] == i` if color c is used by an input sharing a row with i */
+  for (size_t i = 0; i < n_in; ++i)
+    forbidden[i] = n_in;
+  pattern->n_colors = 0;
+  for (size_t i = 0; i < n_in; ++i) {
+    for (size_t r = column_starts[i]; r < column_starts[i+1]; ++r) {
+      uint32_t o = rows[r];
+      for (size_t k = pattern->row_starts[o]; k < pattern->row_starts[o+1]; ++k)
+        if (pattern->columns[k] < i)  /* colored already */
+          forbidden[pattern->colors[pattern->columns[k]]] = i;
+    }
+    uint32_t color = 0;
+    while (forbidden[color] == i)
+      ++color;
+    pattern->colors[i] = color;
+    if (color+1 > pattern->n_colors)
+      pattern->n_colors = color+1;
+  }
+
+  free(column_starts);
+  free(rows);
+  free(forbidden);
+}
+
+/*
+ * detect the sparsity pattern of the Jacobian of `fn`, a function of `n_in`
+ * inputs and `n_out` outputs, at `inputs` and color its inputs
+ */
+static jacobian_pattern_t *jacobian_pattern_create(jacobian_fn_t fn, void *ctx,
+                                                   const AD_REAL *inputs,
+                                                   size_t n_in, size_t n_out) {
+  assert(n_in > 0 && n_out > 0);
+  jacobian_pattern_t *pattern = (jacobian_pattern_t *) malloc(sizeof(jacobian_pattern_t));
+  var_t *outputs = (var_t *) malloc(n_out * sizeof(var_t));
+  if (pattern == NULL || outputs == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return NULL;
+  }
+  pattern->n_in = n_in;
+  pattern->n_out = n_out;
+
+  tape_t *loaded_tape = tape_loaded();
+  tape_t *tape = jacobian_record(fn, ctx, inputs, n_in, outputs);
+  jacobian_pattern_detect(pattern, tape, outputs);
+  jacobian_pattern_color(pattern);
+
+  tape_load(loaded_tape);
+  tape_destroy(tape);
+  free(outputs);
+  return pattern;
+}
+
+static void jacobian_pattern_destroy(jacobian_pattern_t *pattern) {
+  free(pattern->row_starts);
+  free(pattern->columns);
+  free(pattern->colors);
+  free(pattern);
+}
+
+/*
+ * store in `values` the outputs of `fn` at `inputs` and in `nonzeros` the
+ * nonzeros of its Jacobian in the order of `pattern`
+ */
+static void jacobian_sparse(const jacobian_pattern_t *pattern, jacobian_fn_t fn,
+                            void *ctx, const AD_REAL *inputs, AD_REAL *values,
+                            AD_REAL *nonzeros) {
+  size_t n_in = pattern->n_in, n_out = pattern->n_out;
+  var_t *outputs = (var_t *) malloc(n_out * sizeof(var_t));
+  if (outputs == NULL) {
+    perror("jacobian malloc");
+    exit(1);
+    return;
+  }
+  tape_t *loaded_tape = tape_loaded();
+  tape_t *tape = jacobian_record(fn, ctx, inputs, n_in, outputs);
+  for (size_t o = 0; o < n_out; ++o)
+    values[o] = var_value(outputs[o]);
+
+  /* the sweeps seed every input, see `jacobian_forward` */
+  uint32_t length = jacobian_length(outputs, n_out);
+  if (length < n_in)
+    length = (uint32_t) n_in;
+  uint8_t *parents;
+  AD_REAL *partials, *tangents;
+  jacobian_forward_create(tape, length, &parents, &partials, &tangents);
+
+  for (size_t c = 0; c < pattern->n_colors; c += JACOBIAN_CHUNK) {
+    /* lane k is the tangent in the direction of the sum of the inputs of color c+k */
+    jacobian_forward_sweep(tape, parents, partials, tangents, length, n_in, pattern->colors, c);
+    for (size_t o = 0; o < n_out; ++o) {
+      const AD_REAL *tangent = tangents + (size_t) outputs[o].index * JACOBIAN_CHUNK;
+      for (size_t k = pattern->row_starts[o]; k < pattern->row_starts[o+1]; ++k) {
+        uint32_t color = pattern->colors[pattern->columns[k]];
+        if (color >= c && color < c + JACOBIAN_CHUNK)
+          nonzeros[k] = tangent[color - c];
+      }
+    }
+  }
+
+  tape_load(loaded_tape);
+  tape_destroy(tape);
+  free(outputs);
+  free(parents);
+  free(partials);
+  free(tangents);
+}
+
+#endif
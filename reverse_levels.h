@@ -0,0 +1,308 @@
+/*
+ * ============================================================================
+ * Parallel Reverse Pass Over Tape Levels
+ * ============================================================================
+ * This header runs the reverse pass of a tape recorded with `reverse.h` on the
+ * workers of a `pool_t`, for wide graphs such as a loss summing many
+ * independent residuals.
+ *
+ * The level of an entry is the length of the longest path from an input to
+ * it, the parents of an entry always have a lower level than the entry. Once
+ * the entries of the levels above a level have propagated their adjoints, the
+ * adjoints of that level are final, and its entries do not depend on each
+ * other: they are split across the workers, one level after the other from the
+ * highest down. Two entries of a level can share a parent, so the adjoints
+ * of the entries with several consumers are accumulated with atomic adds, and
+ * the ones of the entries with at least `LEVELS_HOT_CONSUMERS` consumers, such
+ * as the parameters of a loss over many samples, which every thread would
+ * update, in private copies per worker that are summed at the end of each
+ * level.
+ *
+ * `levels_create` sorts the entries by level once, the sorted order can be
+ * reused by any number of passes over the same tape.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute the gradient of a sum of N residuals of the same inputs:
+ *   tape_t *tape = tape_create(64);
+ *   tape_load(tape);
+ *   var_t x = var_create(1.0f);
+ *   for (size_t j = 0; j < N; ++j)
+ *     terms[j] = var_sin(x * (float) j);
+ *   var_t loss = var_sum(terms, N);
+ *   pool_t *pool = pool_create(4);
+ *   levels_t *levels = levels_create(tape);
+ *   levels_reverse_pass(levels, pool, tape, loss);
+ *   // var_adjoint(x) returns ∂loss/∂x
+ *   levels_destroy(levels);
+ *   pool_destroy(pool);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - Link with `-pthread`.
+ *  - A chain of `+` puts each partial sum on a level of its own, record long
+ *    sums with `var_sum` so that their terms share levels.
+ *  - Levels of less than `2 * LEVELS_TASK_SIZE` entries are processed by the
+ *    calling thread, the pool is only woken up for the wide ones.
+ *  - The entries of a level are spread over the tape, each level reads its
+ *    own part of every cache line. The tape of a `replay_t`
+ *    (`reverse_replay.h`) is sorted by level, the levels of `replay->tape`
+ *    are contiguous and go as fast as a plain reverse pass on one thread.
+ *  - The order of the atomic adds varies from run to run, so do the last bits
+ *    of the adjoints of the shared entries.
+ *  - Not available with `TAPE_SPILL`, the levels need random access to the
+ *    whole tape.
+ */
+
+#ifndef H_REVERSE_LEVELS
+#define H_REVERSE_LEVELS
+
+#include "reverse.h"
+#include "pool.h"
+
+#ifdef TAPE_SPILL
+#error "reverse_levels.h can not be used with TAPE_SPILL"
+#endif
+
+/* minimum number of entries of a task */
+#ifndef LEVELS_TASK_SIZE
+#define LEVELS_TASK_SIZE 512
+#endif
+
+/* number of tasks per worker, see `RP_TASKS_PER_WORKER` */
+#define LEVELS_TASKS_PER_WORKER 4
+
+/* number of consumers from which an entry gets a private adjoint per worker, at most 255 */
+#ifndef LEVELS_HOT_CONSUMERS
+#define LEVELS_HOT_CONSUMERS 64
+#endif
+
+/* slot of the entries without private adjoints */
+#define LEVELS_NO_SLOT UINT32_MAX
+
+typedef struct {
+  uint32_t length;  /* number of entries of the tape when sorted */
+  uint32_t n_levels;
+  uint32_t *order;  /* the entries sorted by level */
+  uint32_t *level_starts;  /* the entries of level l are order[level_starts[l]] to order[level_starts[l+1]-1] */
+  uint8_t *consumers;  /* number of operands an entry is the parent of, saturated at 255 */
+  uint32_t n_hot;
+  uint32_t *slots;  /* index of the private adjoint of each entry, or `LEVELS_NO_SLOT` */
+  uint32_t *hot;  /* entry of each private adjoint */
+} levels_t;
+
+/* count a consumer of `parent` and raise `level` above the one of `parent` */
+static inline void levels_parent(const uint32_t *entry_levels, uint8_t *consumers,
+                                 uint32_t parent, uint32_t *level) {
+  if (entry_levels[parent] + 1 > *level)
+    *level = entry_levels[parent] + 1;
+  consumers[parent] += consumers[parent] < 255;
+}
+
+/* sort the entries of `tape` by level */
+static levels_t *levels_create(tape_t *tape) {
+  assert(tape->length > 0);
+  uint32_t length = tape->length;
+  levels_t *levels = (levels_t *) malloc(sizeof(levels_t));
+  uint32_t *entry_levels = (uint32_t *) malloc(length * sizeof(uint32_t));
+  uint32_t *order = (uint32_t *) malloc(length * sizeof(uint32_t));
+  uint8_t *consumers = (uint8_t *) calloc(length, sizeof(uint8_t));
+  uint32_t *slots = (uint32_t *) malloc(length * sizeof(uint32_t));
+  if (levels == NULL || entry_levels == NULL || order == NULL || consumers == NULL ||
+      slots == NULL) {
+    perror("levels malloc");
+    exit(1);
+    return NULL;
+  }
+
+  /* the parents of an entry are always recorded before it */
+  uint32_t n_levels = 1;
+  for (uint32_t i = 0; i < length; ++i) {
+    operator_t op = tape_op(tape, i);
+    uint32_t level = 0;
+    if (operator_multi(op)) {
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      for (uint32_t m = start; m < end; ++m)
+        levels_parent(entry_levels, consumers, tape->multi_parents[m], &level);
+    } else {
+      int parents = operator_parents(op);
+      if (parents >= 1)
+        levels_parent(entry_levels, consumers, tape_left(tape, i), &level);
+      if (parents == 2)
+        levels_parent(entry_levels, consumers, tape_right(tape, i), &level);
+    }
+    entry_levels[i] = level;
+    if (level+1 > n_levels)
+      n_levels = level+1;
+  }
+
+  uint32_t n_hot = 0;
+  for (uint32_t i = 0; i < length; ++i)
+    slots[i] = consumers[i] >= LEVELS_HOT_CONSUMERS ? n_hot++ : LEVELS_NO_SLOT;
+  uint32_t *hot = (uint32_t *) malloc((n_hot > 0 ? n_hot : 1) * sizeof(uint32_t));
+  uint32_t *level_starts = (uint32_t *) calloc(n_levels+1, sizeof(uint32_t));
+  if (hot == NULL || level_starts == NULL) {
+    perror("levels malloc");
+    exit(1);
+    return NULL;
+  }
+  for (uint32_t i = 0; i < length; ++i)
+    if (slots[i] != LEVELS_NO_SLOT)
+      hot[slots[i]] = i;
+
+  /* counting sort by level */
+  for (uint32_t i = 0; i < length; ++i)
+    ++level_starts[entry_levels[i] + 1];
+  for (uint32_t l = 0; l < n_levels; ++l)
+    level_starts[l+1] += level_starts[l];
+  for (uint32_t i = 0; i < length; ++i)
+    order[level_starts[entry_levels[i]]++] = i;
+  for (uint32_t l = n_levels; l > 0; --l)  /* the starts were advanced to the ends */
+    level_starts[l] = level_starts[l-1];
+  level_starts[0] = 0;
+
+  free(entry_levels);
+  *levels = {
+    .length = length,
+    .n_levels = n_levels,
+    .order = order,
+    .level_starts = level_starts,
+    .consumers = consumers,
+    .n_hot = n_hot,
+    .slots = slots,
+    .hot = hot,
+  };
+  return levels;
+}
+
+static void levels_destroy(levels_t *levels) {
+  free(levels->order);
+  free(levels->level_starts);
+  free(levels->consumers);
+  free(levels->slots);
+  free(levels->hot);
+  free(levels);
+}
+
+/*
+ * add `x` to the adjoint of `parent`. When other threads propagate entries of
+ * the same level, `privates` is the private adjoints of the worker, otherwise
+ * it is NULL and the adds are plain.
+ */
+static inline void levels_accumulate(const levels_t *levels, tape_t *tape, AD_REAL *privates,
+                                     uint32_t parent, AD_REAL x) {
+  AD_REAL *adjoint = &tape_adjoint(tape, parent);
+  if (privates == NULL || levels->consumers[parent] < 2) {
+    *adjoint += x;
+    return;
+  }
+  if (levels->slots[parent] != LEVELS_NO_SLOT) {
+    privates[levels->slots[parent]] += x;
+    return;
+  }
+  AD_REAL expected, desired;
+  __atomic_load(adjoint, &expected, __ATOMIC_RELAXED);
+  do {
+    desired = expected + x;
+  } while (!__atomic_compare_exchange(adjoint, &expected, &desired, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* propagate the adjoints of the entries order[start] to order[end-1] */
+static void levels_propagate(const levels_t *levels, tape_t *tape, AD_REAL *privates,
+                             uint32_t start, uint32_t end) {
+  for (uint32_t k = start; k < end; ++k) {
+    uint32_t i = levels->order[k];
+    AD_REAL adjoint = tape_adjoint(tape, i);
+    if (adjoint == 0)
+      continue;  /* the output does not depend on it */
+    if (operator_multi(tape_op(tape, i))) {
+      uint32_t m_start = tape_multi_start(tape, i), m_end = m_start + tape_multi_count(tape, i);
+      for (uint32_t m = m_start; m < m_end; ++m)
+        levels_accumulate(levels, tape, privates, tape->multi_parents[m],
+                          adjoint * tape->multi_partials[m]);
+      continue;
+    }
+    AD_REAL left_partial, right_partial;
+    int parents = tape_partials(tape, i, &left_partial, &right_partial);
+    if (parents == 0)
+      continue;
+    levels_accumulate(levels, tape, privates, tape_left(tape, i), adjoint * left_partial);
+    if (parents == 2)
+      levels_accumulate(levels, tape, privates, tape_right(tape, i), adjoint * right_partial);
+  }
+}
+
+typedef struct {
+  const levels_t *levels;
+  tape_t *tape;
+  AD_REAL *privates;  /* `n_hot` private adjoints per worker */
+  uint32_t start;  /* the level is order[start] to order[end-1] */
+  uint32_t end;
+  size_t n_tasks;
+} levels_param_t;
+
+static void levels_task(size_t task_id, size_t worker_id, void *param_ptr) {
+  levels_param_t *param = (levels_param_t *) param_ptr;
+  uint64_t count = param->end - param->start;
+  uint32_t start = param->start + count * task_id / param->n_tasks;
+  uint32_t end = param->start + count * (task_id+1) / param->n_tasks;
+  AD_REAL *privates = param->privates + worker_id * param->levels->n_hot;
+  levels_propagate(param->levels, param->tape, privates, start, end);
+}
+
+/*
+ * same as `tape_reverse_pass`, the levels of `tape` are processed in parallel
+ * on the workers of `pool`, `tape` must not have grown since `levels_create`
+ */
+static void levels_reverse_pass(const levels_t *levels, pool_t *pool, tape_t *tape,
+                                var_t start) {
+  assert(tape->length == levels->length && start.index < tape->length);
+#ifdef TAPE_SOA
+  memset(tape->adjoints, 0, tape->length * sizeof(*tape->adjoints));
+#else
+  for (size_t i = 0; i < tape->length; ++i)
+    tape->entries[i].adjoint = 0;
+#endif
+  tape_adjoint(tape, start.index) = 1;
+
+  size_t workers = pool_workers(pool);
+  size_t max_tasks = workers * LEVELS_TASKS_PER_WORKER;
+  /* one more so that no worker gets a zero-sized array */
+  AD_REAL *privates = (AD_REAL *) calloc(workers * levels->n_hot + 1, sizeof(AD_REAL));
+  if (privates == NULL) {
+    perror("levels malloc");
+    exit(1);
+    return;
+  }
+
+  for (uint32_t l = levels->n_levels; l-- > 1;) {  /* level 0 has no parents */
+    uint32_t level_start = levels->level_starts[l], level_end = levels->level_starts[l+1];
+    size_t n_tasks = (level_end - level_start) / LEVELS_TASK_SIZE;
+    if (n_tasks < 2 || workers < 2) {
+      levels_propagate(levels, tape, NULL, level_start, level_end);
+      continue;
+    }
+    levels_param_t param = {
+      .levels = levels,
+      .tape = tape,
+      .privates = privates,
+      .start = level_start,
+      .end = level_end,
+      .n_tasks = n_tasks < max_tasks ? n_tasks : max_tasks,
+    };
+    pool_run(pool, &levels_task, &param, param.n_tasks);
+
+    /* the private adjoints are complete once the level is */
+    for (size_t w = 0; w < workers; ++w) {
+      AD_REAL *worker_privates = privates + w * levels->n_hot;
+      for (uint32_t h = 0; h < levels->n_hot; ++h) {
+        tape_adjoint(tape, levels->hot[h]) += worker_privates[h];
+        worker_privates[h] = 0;
+      }
+    }
+  }
+  free(privates);
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ * ============================================================================
+ * Parallel Reverse Mode Autodiff Over Independent Samples
+ * ============================================================================
+ * This header spreads independent reverse mode evaluations (typically the
+ * per-sample terms of a loss) across the workers of a `pool_t`. Each task
+ * records the samples it is given on the tape of its worker, runs the reverse
+ * pass and accumulates the gradient locally. The partial gradients are summed
+ * once all the tasks are done.
+ *
+ * The tapes of the workers are kept by a `reverse_parallel_t` from one call to
+ * the next, they are only cleared between two samples and stop growing once
+ * they hold the largest sample.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute the gradient of the sum over the samples s of (x - s)²:
+ *   var_t sample_loss(const var_t *inputs, size_t sample, void *ctx) {
+ *     var_t delta = inputs[0] - (float) sample;
+ *     return delta * delta;
+ *   }
+ *   float x = 1, grad[1];
+ *   pool_t *pool = pool_create(4);
+ *   reverse_parallel_t *rp = reverse_parallel_create(pool);
+ *   float loss = reverse_parallel_gradient(rp, &sample_loss, NULL, &x, 1, 100, grad);
+ *   reverse_parallel_destroy(rp);
+ *   pool_destroy(pool);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - Link with `-pthread`.
+ *  - `fn` is called concurrently from several threads, it must not write to
+ *    shared state.
+ *  - `reverse_parallel_gradient` must not be called concurrently with the same
+ *    `reverse_parallel_t`.
+ */
+
+#ifndef H_REVERSE_PARALLEL
+#define H_REVERSE_PARALLEL
+
+#include "reverse.h"
+#include "pool.h"
+
+/*
+ * number of tasks per worker, more tasks than workers lets the pool balance the
+ * load by stealing
+ */
+#define RP_TASKS_PER_WORKER 4
+
+/*
+ * record the loss of sample `sample` on the loaded tape, `inputs` are the
+ * `n_inputs` variables the gradient is computed with respect to
+ */
+typedef var_t (*sample_loss_t)(const var_t *inputs, size_t sample, void *ctx);
+
+typedef struct {
+  pool_t *pool;
+  tape_t **tapes;  /* tape of each worker of `pool` */
+} reverse_parallel_t;
+
+static reverse_parallel_t *reverse_parallel_create(pool_t *pool) {
+  size_t workers = pool_workers(pool);
+  reverse_parallel_t *rp = (reverse_parallel_t *) malloc(sizeof(reverse_parallel_t));
+  tape_t **tapes = (tape_t **) malloc(workers * sizeof(tape_t *));
+  if (rp == NULL || tapes == NULL) {
+    perror("reverse_parallel malloc");
+    exit(1);
+    return NULL;
+  }
+  for (size_t worker_id = 0; worker_id < workers; ++worker_id)
+    tapes[worker_id] = tape_create(64);
+  *rp = {
+    .pool = pool,
+    .tapes = tapes,
+  };
+  return rp;
+}
+
+static void reverse_parallel_destroy(reverse_parallel_t *rp) {
+  for (size_t worker_id = 0; worker_id < pool_workers(rp->pool); ++worker_id)
+    tape_destroy(rp->tapes[worker_id]);
+  free(rp->tapes);
+  free(rp);
+}
+
+typedef struct {
+  sample_loss_t fn;
+  void *ctx;
+  const AD_REAL *inputs;
+  size_t n_inputs;
+  size_t n_samples;
+  size_t n_tasks;
+  tape_t **tapes;
+  var_t *worker_inputs;  /* `n_inputs` variables per worker */
+  AD_REAL *task_grads;  /* `n_inputs` partial gradients per task */
+  AD_REAL *task_values;
+} rp_param_t;
+
+/* record, differentiate and accumulate the samples of task `task_id` */
+static void rp_task(size_t task_id, size_t worker_id, void *param_ptr) {
+  rp_param_t *param = (rp_param_t *) param_ptr;
+  size_t start_sample = param->n_samples * task_id / param->n_tasks;
+  size_t end_sample = param->n_samples * (task_id+1) / param->n_tasks;
+  AD_REAL *grad = param->task_grads + task_id * param->n_inputs;
+  AD_REAL value = 0;
+
+  /* worker 0 is the calling thread, restore its tape when done */
+  tape_t *loaded_tape = tape_loaded();
+  tape_t *tape = param->tapes[worker_id];
+  tape_load(tape);
+  var_t *inputs = param->worker_inputs + worker_id * param->n_inputs;
+
+  memset(grad, 0, param->n_inputs * sizeof(AD_REAL));
+  for (size_t sample = start_sample; sample < end_sample; ++sample) {
+    tape_clear(tape);
+    for (size_t i = 0; i < param->n_inputs; ++i)
+      inputs[i] = var_create(param->inputs[i]);
+    var_t loss = param->fn(inputs, sample, param->ctx);
+
+    tape_reverse_pass(tape, loss);
+    value += var_value(loss);
+    for (size_t i = 0; i < param->n_inputs; ++i)
+      grad[i] += var_adjoint(inputs[i]);
+  }
+  param->task_values[task_id] = value;
+
+  tape_load(loaded_tape);
+}
+
+/*
+ * store in `grad` the gradient of the sum of the `n_samples` sample losses
+ * computed by `fn` using the workers of the pool of `rp` and return the value
+ * of that sum
+ */
+static AD_REAL reverse_parallel_gradient(reverse_parallel_t *rp, sample_loss_t fn, void *ctx,
+                                       const AD_REAL *inputs, size_t n_inputs,
+                                       size_t n_samples, AD_REAL *grad) {
+  size_t workers = pool_workers(rp->pool);
+  size_t n_tasks = workers * RP_TASKS_PER_WORKER;
+  if (n_tasks > n_samples)
+    n_tasks = n_samples > 0 ? n_samples : 1;
+  var_t *worker_inputs = (var_t *) malloc(workers * n_inputs * sizeof(var_t));
+  AD_REAL *task_grads = (AD_REAL *) malloc(n_tasks * n_inputs * sizeof(AD_REAL));
+  AD_REAL *task_values = (AD_REAL *) malloc(n_tasks * sizeof(AD_REAL));
+  if (worker_inputs == NULL || task_grads == NULL || task_values == NULL) {
+    perror("reverse_parallel malloc");
+    exit(1);
+    return 0;
+  }
+
+  rp_param_t param = {
+    .fn = fn,
+    .ctx = ctx,
+    .inputs = inputs,
+    .n_inputs = n_inputs,
+    .n_samples = n_samples,
+    .n_tasks = n_tasks,
+    .tapes = rp->tapes,
+    .worker_inputs = worker_inputs,
+    .task_grads = task_grads,
+    .task_values = task_values,
+  };
+  pool_run(rp->pool, &rp_task, &param, n_tasks);
+
+  AD_REAL value = 0;
+  memset(grad, 0, n_inputs * sizeof(AD_REAL));
+  for (size_t task_id = 0; task_id < n_tasks; ++task_id) {
+    value += task_values[task_id];
+    for (size_t i = 0; i < n_inputs; ++i)
+      grad[i] += task_grads[task_id * n_inputs + i];
+  }
+
+  free(worker_inputs);
+  free(task_grads);
+  free(task_values);
+  return value;
+}
+
+#endif
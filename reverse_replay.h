@@ -0,0 +1,319 @@
+/*
+ * ============================================================================
+ * Frozen Tape Replay
+ * ============================================================================
+ * When the structure of the computation graph does not change between two
+ * evaluations, only the values of the inputs do, the graph can be recorded
+ * once with `reverse.h` and then replayed: `replay_forward` recomputes the
+ * values of every entry from the new inputs and `replay_reverse_pass`
+ * propagates the adjoints, without going through the operator overloads and
+ * `tape_extend` again.
+ *
+ * `replay_create` freezes a recorded tape into a copy whose entries are sorted
+ * by level (length of the longest path from an input) and, within a level, by
+ * operator. The entries of a level do not depend on each other, so the sorted
+ * copy is still in a valid evaluation order, and entries of the same operator
+ * end up next to each other: the forward replay dispatches on the operator
+ * once per run of identical operators instead of once per entry.
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute ∂f/∂x of f(x, y) = x * y + y for several values of x:
+ *   tape_t *tape = tape_create(64);
+ *   tape_load(tape);
+ *   var_t x = var_create(1.0f);
+ *   var_t y = var_create(2.0f);
+ *   var_t f = x * y + y;
+ *   replay_t *replay = replay_create(tape);
+ *   for (size_t i = 0; i < 10; ++i) {
+ *     replay_set_value(replay, x, (float) i);
+ *     replay_forward(replay);
+ *     replay_reverse_pass(replay, f);
+ *     // replay_value(replay, f) returns f, replay_adjoint(replay, x) ∂f/∂x
+ *   }
+ *   replay_destroy(replay);
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - The variables of the recorded tape keep identifying the same values in
+ *    the replay, the recorded tape can be destroyed once frozen.
+ *  - Every entry recorded with `var_create` can be given a new value, the
+ *    other entries are recomputed by `replay_forward`.
+ *  - Branches taken on the values while recording are frozen as well, the
+ *    replay is only valid for inputs that take the same branches.
+ *  - Preaccumulated entries (`var_preaccumulate`) hold partial derivatives
+ *    that can not be recomputed from new inputs, their tapes are rejected.
+ */
+
+#ifndef H_REVERSE_REPLAY
+#define H_REVERSE_REPLAY
+
+#include "reverse.h"
+
+typedef struct {
+  tape_t *tape;  /* the sorted copy of the recorded tape */
+  uint32_t *index;  /* index in `tape` of each entry of the recorded tape */
+  uint32_t n_runs;
+  uint32_t *run_starts;  /* entries [run_starts[r], run_starts[r+1]) share the same operator */
+} replay_t;
+
+/*
+ * stable counting sort of `order` by `keys[order[k]]`, the keys are in
+ * [0, n_keys), `buffer` has the size of `order`
+ */
+static void replay_sort(uint32_t *order, uint32_t *buffer, size_t length,
+                        const uint32_t *keys, size_t n_keys) {
+  uint32_t *counts = (uint32_t *) calloc(n_keys+1, sizeof(uint32_t));
+  if (counts == NULL) {
+    perror("replay malloc");
+    exit(1);
+    return;
+  }
+  for (size_t k = 0; k < length; ++k)
+    ++counts[keys[order[k]] + 1];
+  for (size_t key = 0; key < n_keys; ++key)
+    counts[key+1] += counts[key];
+  for (size_t k = 0; k < length; ++k)
+    buffer[counts[keys[order[k]]]++] = order[k];
+  memcpy(order, buffer, length * sizeof(uint32_t));
+  free(counts);
+}
+
+/* freeze the entries recorded on `tape` */
+static replay_t *replay_create(tape_t *tape) {
+  assert(tape->length > 0);
+  size_t length = tape->length;
+  replay_t *replay = (replay_t *) malloc(sizeof(replay_t));
+  uint32_t *index = (uint32_t *) malloc(length * sizeof(uint32_t));
+  uint32_t *order = (uint32_t *) malloc(length * sizeof(uint32_t));
+  uint32_t *levels = (uint32_t *) malloc(length * sizeof(uint32_t));
+  uint32_t *ops = (uint32_t *) malloc(length * sizeof(uint32_t));
+  uint32_t *run_starts = (uint32_t *) malloc((length+1) * sizeof(uint32_t));
+  if (replay == NULL || index == NULL || order == NULL || levels == NULL ||
+      ops == NULL || run_starts == NULL) {
+    perror("replay malloc");
+    exit(1);
+    return NULL;
+  }
+
+  /* the parents of an entry are always recorded before it */
+  uint32_t max_level = 0;
+  for (size_t i = 0; i < length; ++i) {
+    order[i] = i;
+    ops[i] = tape_op(tape, i);
+    if (ops[i] == MULTI) {
+      fprintf(stderr, "replay: preaccumulated entries can not be replayed\n");
+      exit(1);
+    }
+    int parents = operator_parents((operator_t) ops[i]);
+    if (operator_multi((operator_t) ops[i])) {
+      uint32_t start = tape_multi_start(tape, i), end = start + tape_multi_count(tape, i);
+      levels[i] = 0;
+      for (uint32_t m = start; m < end; ++m)
+        if (levels[tape->multi_parents[m]] + 1 > levels[i])
+          levels[i] = levels[tape->multi_parents[m]] + 1;
+    } else if (parents == 0) {
+      levels[i] = 0;
+    } else {
+      uint32_t left_level = levels[tape_left(tape, i)];
+      uint32_t right_level = parents == 2 ? levels[tape_right(tape, i)] : 0;
+      levels[i] = 1 + (left_level > right_level ? left_level : right_level);
+    }
+    if (levels[i] > max_level)
+      max_level = levels[i];
+  }
+
+  /* sorting by operator then by level sorts by (level, operator) */
+  replay_sort(order, index, length, ops, OPERATOR_COUNT);
+  replay_sort(order, index, length, levels, max_level+1);
+  for (size_t k = 0; k < length; ++k)
+    index[order[k]] = k;
+
+  tape_t *sorted = tape_create(length);
+  sorted->length = length;
+  uint32_t n_runs = 0;
+  for (size_t k = 0; k < length; ++k) {
+    uint32_t i = order[k];
+    operator_t op = tape_op(tape, i);
+    if (operator_constant(op)) {
+      tape_set_constant(sorted, k, op, tape_value(tape, i),
+                        index[tape_left(tape, i)], tape_constant(tape, i));
+    } else if (operator_multi(op)) {
+      uint32_t start = tape_multi_start(tape, i), count = tape_multi_count(tape, i);
+      tape_multi_reserve(sorted, count);
+      for (uint32_t m = 0; m < count; ++m) {
+        sorted->multi_parents[sorted->multi_length + m] = index[tape->multi_parents[start + m]];
+        sorted->multi_partials[sorted->multi_length + m] = tape->multi_partials[start + m];
+      }
+      tape_set(sorted, k, op, tape_value(tape, i), sorted->multi_length, count);
+      sorted->multi_length += count;
+    } else {
+      uint32_t right = operator_parents(op) == 2 ? index[tape_right(tape, i)] : 0;
+      tape_set(sorted, k, op, tape_value(tape, i), index[tape_left(tape, i)], right);
+    }
+    if (k == 0 || op != tape_op(sorted, k-1))
+      run_starts[n_runs++] = k;
+  }
+  run_starts[n_runs] = length;
+
+  free(order);
+  free(levels);
+  free(ops);
+  *replay = {
+    .tape = sorted,
+    .index = index,
+    .n_runs = n_runs,
+    .run_starts = run_starts,
+  };
+  return replay;
+}
+
+static void replay_destroy(replay_t *replay) {
+  tape_destroy(replay->tape);
+  free(replay->index);
+  free(replay->run_starts);
+  free(replay);
+}
+
+/* index in the replay of the variable `a` of the recorded tape */
+static inline uint32_t replay_index(replay_t *replay, var_t a) {
+  assert(a.index < replay->tape->length);
+  return replay->index[a.index];
+}
+
+/* give a new value to the input `a`, taken into account by `replay_forward` */
+static void replay_set_value(replay_t *replay, var_t a, AD_REAL value) {
+  uint32_t i = replay_index(replay, a);
+  assert(tape_op(replay->tape, i) == NIL);
+  tape_value(replay->tape, i) = value;
+}
+
+/* recompute the values of all the entries from the values of the inputs */
+static void replay_forward(replay_t *replay) {
+  tape_t *tape = replay->tape;
+
+#define REPLAY_UNARY(expr)                                  \
+  for (uint32_t i = start; i < end; ++i) {                  \
+    AD_REAL left = tape_value(tape, tape_left(tape, i));    \
+    tape_value(tape, i) = (expr);                           \
+  }
+
+#define REPLAY_BINARY(expr)                                 \
+  for (uint32_t i = start; i < end; ++i) {                  \
+    AD_REAL left = tape_value(tape, tape_left(tape, i));    \
+    AD_REAL right = tape_value(tape, tape_right(tape, i));  \
+    tape_value(tape, i) = (expr);                           \
+  }
+
+#define REPLAY_CONSTANT(expr)                               \
+  for (uint32_t i = start; i < end; ++i) {                  \
+    AD_REAL left = tape_value(tape, tape_left(tape, i));    \
+    AD_REAL constant = tape_constant(tape, i);              \
+    tape_value(tape, i) = (expr);                           \
+  }
+
+  for (uint32_t r = 0; r < replay->n_runs; ++r) {
+    uint32_t start = replay->run_starts[r];
+    uint32_t end = replay->run_starts[r+1];
+    switch (tape_op(tape, start)) {
+      case NIL:
+        break;
+      case NEG:
+        REPLAY_UNARY(-left);
+        break;
+      case ADD:
+        REPLAY_BINARY(left + right);
+        break;
+      case SUB:
+        REPLAY_BINARY(left - right);
+        break;
+      case MUL:
+        REPLAY_BINARY(left * right);
+        break;
+      case DIV:
+        REPLAY_BINARY(left / right);
+        break;
+      case POW:
+        REPLAY_BINARY(pow(left, right));
+        break;
+      case EXP:
+        REPLAY_UNARY(exp(left));
+        break;
+      case COS:
+        REPLAY_UNARY(cos(left));
+        break;
+      case SIN:
+        REPLAY_UNARY(sin(left));
+        break;
+      case SQRT:
+        REPLAY_UNARY(sqrt(left));
+        break;
+      case ADD_CONST:
+        REPLAY_CONSTANT(left + constant);
+        break;
+      case CONST_SUB:
+        REPLAY_CONSTANT(constant - left);
+        break;
+      case MUL_CONST:
+        REPLAY_CONSTANT(left * constant);
+        break;
+      case DIV_CONST:
+        REPLAY_CONSTANT(left / constant);
+        break;
+      case CONST_DIV:
+        REPLAY_CONSTANT(constant / left);
+        break;
+      case POW_CONST:
+        REPLAY_CONSTANT(pow(left, constant));
+        break;
+      case CONST_POW:
+        REPLAY_CONSTANT(pow(constant, left));
+        break;
+      case MULTI:  /* rejected by `replay_create` */
+        break;
+      case SUM:
+        for (uint32_t i = start; i < end; ++i) {
+          uint32_t m_start = tape_multi_start(tape, i), m_end = m_start + tape_multi_count(tape, i);
+          AD_REAL value = 0;
+          for (uint32_t m = m_start; m < m_end; ++m)
+            value += tape->multi_partials[m] * tape_value(tape, tape->multi_parents[m]);
+          tape_value(tape, i) = value;
+        }
+        break;
+      case DOT:  /* the partials are the values of the other operands */
+        for (uint32_t i = start; i < end; ++i) {
+          uint32_t m_start = tape_multi_start(tape, i), m_end = m_start + tape_multi_count(tape, i);
+          AD_REAL value = 0;
+          for (uint32_t m = m_start; m < m_end; m += 2) {
+            AD_REAL a = tape_value(tape, tape->multi_parents[m]);
+            AD_REAL b = tape_value(tape, tape->multi_parents[m+1]);
+            tape->multi_partials[m] = b;
+            tape->multi_partials[m+1] = a;
+            value += a * b;
+          }
+          tape_value(tape, i) = value;
+        }
+        break;
+    }
+  }
+
+#undef REPLAY_UNARY
+#undef REPLAY_BINARY
+#undef REPLAY_CONSTANT
+}
+
+/* same as `tape_reverse_pass` with `output` a variable of the recorded tape */
+static void replay_reverse_pass(replay_t *replay, var_t output) {
+  var_t start = {replay_index(replay, output)};
+  tape_reverse_pass(replay->tape, start);
+}
+
+static AD_REAL replay_value(replay_t *replay, var_t a) {
+  return tape_value(replay->tape, replay_index(replay, a));
+}
+
+static AD_REAL replay_adjoint(replay_t *replay, var_t a) {
+  return tape_adjoint(replay->tape, replay_index(replay, a));
+}
+
+#endif
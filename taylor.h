@@ -0,0 +1,257 @@
+/*
+ * ============================================================================
+ * Taylor Mode Autodiff With Truncated Power Series
+ * ============================================================================
+ * This header-only C implementation propagates truncated Taylor series
+ * through a computation using operator overloading on a custom `taylor_t`
+ * type, which gives the derivatives of any order of the computation in one
+ * direction.
+ *
+ * Each `taylor_t` variable holds `coefficients[TAYLOR_LEN]`, the coefficients
+ * of the Taylor series of the variable along the curve x(t) = x + t v:
+ * coefficient k is the k-th derivative with respect to t divided by k!.
+ * Every operation computes the coefficients of its result from the
+ * coefficients of its operands with the recurrences of univariate Taylor
+ * arithmetic, in O(TAYLOR_LEN²) operations, where nesting first order forward
+ * mode K times would take O(2^K).
+ *
+ * Usage Example:
+ * ----------------------------------------------------------------------------
+ * To compute f(x), f'(x) and f''(x) at x = 1 for f(x) = sin(x) e^x, e.g. for a
+ * Halley step x - 2 f f' / (2 f'² - f f''):
+ *   taylor_t x = taylor_variable(1.0, 1.0);  // x(t) = 1 + t
+ *   taylor_t f = var_sin(x) * var_exp(x);
+ *   // taylor_derivative(f, k) returns the k-th derivative of f at 1
+ *
+ * Notes:
+ * ----------------------------------------------------------------------------
+ *  - The macro `TAYLOR_LEN`, the number of coefficients, i.e. the highest
+ *    derivative order plus one, must be defined before including this header.
+ *  - Define `AD_REAL` (default `float`) to change the type of the
+ *    coefficients, e.g. `double`, the high order coefficients of float series
+ *    quickly lose precision.
+ *  - Directional derivatives of a function of several inputs are given by
+ *    seeding each input with its component of the direction, e.g.
+ *    `taylor_variable(x[i], v[i])`.
+ *  - The operations are named as in `forward.h`, so that a computation can be
+ *    written once for both headers.
+ */
+
+#ifndef H_TAYLOR
+#define H_TAYLOR
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#ifndef TAYLOR_LEN
+#error "The TAYLOR_LEN macro must set before including taylor.h"
+#define TAYLOR_LEN 1
+#endif
+
+#ifndef AD_REAL
+#define AD_REAL float
+#endif
+
+typedef struct {
+  AD_REAL coefficients[TAYLOR_LEN];
+} taylor_t;
+
+/* a constant, its derivatives are 0 */
+static taylor_t taylor_create(AD_REAL value) {
+  taylor_t a;
+  memset(&a, 0, sizeof(a));
+  a.coefficients[0] = value;
+  return a;
+}
+
+/* the input `value` + t `direction` */
+static taylor_t taylor_variable(AD_REAL value, AD_REAL direction) {
+  taylor_t a = taylor_create(value);
+#if TAYLOR_LEN > 1
+  a.coefficients[1] = direction;
+#endif
+  return a;
+}
+
+static AD_REAL taylor_value(const taylor_t &a) {
+  return a.coefficients[0];
+}
+
+/* k-th derivative of `a` with respect to t, k! times coefficient k */
+static AD_REAL taylor_derivative(const taylor_t &a, size_t k) {
+  assert(k < TAYLOR_LEN);
+  AD_REAL factorial = 1;
+  for (size_t j = 2; j <= k; ++j)
+    factorial *= j;
+  return factorial * a.coefficients[k];
+}
+
+/* variable operations */
+static taylor_t operator-(taylor_t a) {
+  for (size_t k = 0; k < TAYLOR_LEN; ++k)
+    a.coefficients[k] = -a.coefficients[k];
+  return a;
+}
+
+/* variable variable operations */
+static taylor_t operator+(taylor_t a, const taylor_t &b) {
+  for (size_t k = 0; k < TAYLOR_LEN; ++k)
+    a.coefficients[k] += b.coefficients[k];
+  return a;
+}
+
+static taylor_t operator-(taylor_t a, const taylor_t &b) {
+  for (size_t k = 0; k < TAYLOR_LEN; ++k)
+    a.coefficients[k] -= b.coefficients[k];
+  return a;
+}
+
+/* Cauchy product, c_k = Σ a_j b_k-j */
+static taylor_t operator*(const taylor_t &a, const taylor_t &b) {
+  taylor_t c;
+  for (size_t k = 0; k < TAYLOR_LEN; ++k) {
+    AD_REAL sum = 0;
+    for (size_t j = 0; j <= k; ++j)
+      sum += a.coefficients[j] * b.coefficients[k-j];
+    c.coefficients[k] = sum;
+  }
+  return c;
+}
+
+/* c = a / b solves c b = a, c_k = (a_k - Σ_{j>0} b_j c_k-j) / b_0 */
+static taylor_t operator/(const taylor_t &a, const taylor_t &b) {
+  assert(b.coefficients[0] != 0);
+  taylor_t c;
+  for (size_t k = 0; k < TAYLOR_LEN; ++k) {
+    AD_REAL sum = a.coefficients[k];
+    for (size_t j = 1; j <= k; ++j)
+      sum -= b.coefficients[j] * c.coefficients[k-j];
+    c.coefficients[k] = sum / b.coefficients[0];
+  }
+  return c;
+}
+
+static void operator+=(taylor_t &a, const taylor_t &b) {
+  a = a + b;
+}
+
+static void operator-=(taylor_t &a, const taylor_t &b) {
+  a = a - b;
+}
+
+static void operator*=(taylor_t &a, const taylor_t &b) {
+  a = a * b;
+}
+
+static void operator/=(taylor_t &a, const taylor_t &b) {
+  a = a / b;
+}
+
+/* variable float operations */
+static taylor_t operator+(taylor_t a, AD_REAL b) {
+  a.coefficients[0] += b;
+  return a;
+}
+
+static taylor_t operator-(taylor_t a, AD_REAL b) {
+  a.coefficients[0] -= b;
+  return a;
+}
+
+static taylor_t operator*(taylor_t a, AD_REAL b) {
+  for (size_t k = 0; k < TAYLOR_LEN; ++k)
+    a.coefficients[k] *= b;
+  return a;
+}
+
+static taylor_t operator/(AD_REAL a, const taylor_t &b) {
+  return taylor_create(a) / b;
+}
+
+static void operator+=(taylor_t &a, AD_REAL b) {
+  a.coefficients[0] += b;
+}
+
+static void operator-=(taylor_t &a, AD_REAL b) {
+  a.coefficients[0] -= b;
+}
+
+static void operator*=(taylor_t &a, AD_REAL b) {
+  a = a * b;
+}
+
+/* variable functions */
+
+/* p = a^b solves a p' = b p a', p_k = Σ_{j>0} ((b+1) j - k) a_j p_k-j / (k a_0) */
+static taylor_t var_pow(const taylor_t &a, AD_REAL b) {
+  assert(a.coefficients[0] > 0);
+  taylor_t p;
+  p.coefficients[0] = pow(a.coefficients[0], b);
+  for (size_t k = 1; k < TAYLOR_LEN; ++k) {
+    AD_REAL sum = 0;
+    for (size_t j = 1; j <= k; ++j)
+      sum += ((b+1) * j - k) * a.coefficients[j] * p.coefficients[k-j];
+    p.coefficients[k] = sum / (k * a.coefficients[0]);
+  }
+  return p;
+}
+
+/* e = exp(a) solves e' = e a', e_k = Σ_{j>0} j a_j e_k-j / k */
+static taylor_t var_exp(const taylor_t &a) {
+  taylor_t e;
+  e.coefficients[0] = exp(a.coefficients[0]);
+  for (size_t k = 1; k < TAYLOR_LEN; ++k) {
+    AD_REAL sum = 0;
+    for (size_t j = 1; j <= k; ++j)
+      sum += j * a.coefficients[j] * e.coefficients[k-j];
+    e.coefficients[k] = sum / k;
+  }
+  return e;
+}
+
+/* s = sin(a) and c = cos(a) solve s' = c a' and c' = -s a' together */
+static void taylor_sincos(const taylor_t &a, taylor_t *s, taylor_t *c) {
+  s->coefficients[0] = sin(a.coefficients[0]);
+  c->coefficients[0] = cos(a.coefficients[0]);
+  for (size_t k = 1; k < TAYLOR_LEN; ++k) {
+    AD_REAL sum_s = 0, sum_c = 0;
+    for (size_t j = 1; j <= k; ++j) {
+      sum_s += j * a.coefficients[j] * c->coefficients[k-j];
+      sum_c -= j * a.coefficients[j] * s->coefficients[k-j];
+    }
+    s->coefficients[k] = sum_s / k;
+    c->coefficients[k] = sum_c / k;
+  }
+}
+
+static taylor_t var_cos(const taylor_t &a) {
+  taylor_t s, c;
+  taylor_sincos(a, &s, &c);
+  return c;
+}
+
+static taylor_t var_sin(const taylor_t &a) {
+  taylor_t s, c;
+  taylor_sincos(a, &s, &c);
+  return s;
+}
+
+/* r = sqrt(a) solves r r = a, r_k = (a_k - Σ_{0<j<k} r_j r_k-j) / (2 r_0) */
+static taylor_t var_sqrt(const taylor_t &a) {
+  /* assert(a.coefficients[0] > 0); */
+  taylor_t r;
+  r.coefficients[0] = sqrt(a.coefficients[0]);
+  for (size_t k = 1; k < TAYLOR_LEN; ++k) {
+    AD_REAL sum = a.coefficients[k];
+    for (size_t j = 1; j < k; ++j)
+      sum -= r.coefficients[j] * r.coefficients[k-j];
+    r.coefficients[k] = sum / (2 * r.coefficients[0]);
+  }
+  return r;
+}
+
+#endif